@@ -0,0 +1,41 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//| 
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+// Replaces operator new/delete of the plugin module to feed AllocationTracker.
+// Array, nothrow and sized forms of the CRT forward to these, aligned forms are left as is.
+
+#include "stdafx.h"
+#include "AllocationTracker.h"
+#include <new>
+
+void* operator new(size_t size)
+{
+    AllocationTracker::OnAllocate(size);
+
+    while (true)
+    {
+        if (void* memory = malloc(size == 0 ? 1 : size))
+            return memory;
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr)
+            throw std::bad_alloc();
+
+        handler();
+    }
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
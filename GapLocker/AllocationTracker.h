@@ -0,0 +1,91 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include "StatsSegment.h"
+#include <boost/preprocessor/cat.hpp>
+
+// Opt-in accounting of heap allocations made by the plugin module (operator new is replaced in AllocationTracker.cpp).
+// Allocations are attributed to the innermost ALLOC_SCOPE of the current thread.
+// The scope is thread local and executors reset it around resumed work, so in coroutines a scope must not span a
+// co_await: it is opened in the synchronous sections between suspensions.
+class AllocationTracker
+{
+public:
+    static void Enable(bool value)
+    {
+        if (enabled.exchange(value) != value)
+            LOG_FILE() << "Allocation tracking " << (value ? "enabled" : "disabled");
+    }
+
+    static void OnAllocate(size_t size)
+    {
+        if (!enabled.load(std::memory_order_relaxed))
+            return;
+
+        auto& counter = counters[currentScope];
+        counter.Count.fetch_add(1, std::memory_order_relaxed);
+        counter.Bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    //executors call it before running foreign work on a thread
+    static void ResetThreadScope()
+    {
+        currentScope = ALLOCATION_OTHER;
+    }
+
+    static void Publish(const StatsSegment& stats)
+    {
+        for (size_t scope = 0; scope < ALLOCATION_SCOPE_TOTAL; scope++)
+        {
+            stats.Set(&StatsLayout::AllocationEntries, scope, counters[scope].Entries.load(std::memory_order_relaxed));
+            stats.Set(&StatsLayout::AllocationCount, scope, counters[scope].Count.load(std::memory_order_relaxed));
+            stats.Set(&StatsLayout::AllocationBytes, scope, counters[scope].Bytes.load(std::memory_order_relaxed));
+        }
+    }
+
+    class Scope
+    {
+    public:
+        explicit Scope(AllocationScope scope) :
+            previous(currentScope)
+        {
+            currentScope = scope;
+
+            if (enabled.load(std::memory_order_relaxed))
+                counters[scope].Entries.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        ~Scope()
+        {
+            currentScope = previous;
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        AllocationScope previous;
+    };
+
+private:
+    struct Counter
+    {
+        std::atomic<UINT64> Entries;
+        std::atomic<UINT64> Count;
+        std::atomic<UINT64> Bytes;
+    };
+
+    static inline std::atomic<bool> enabled = false;
+    static inline thread_local AllocationScope currentScope = ALLOCATION_OTHER;
+    static inline Counter counters[ALLOCATION_SCOPE_TOTAL] = {};
+};
+
+#define ALLOC_SCOPE(scope) AllocationTracker::Scope BOOST_PP_CAT(allocationScope, __LINE__)(scope)
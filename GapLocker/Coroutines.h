@@ -0,0 +1,373 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include <coroutine>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <utility>
+
+// Runs coroutine continuations, e.g. on a thread pool
+class IExecutor
+{
+public:
+    virtual ~IExecutor() = default;
+
+    virtual void Post(std::coroutine_handle<> handle) = 0;
+
+    //co_await executor.Schedule() continues the coroutine on the executor
+    auto Schedule()
+    {
+        struct Awaiter
+        {
+            IExecutor& executor;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { executor.Post(handle); }
+            void await_resume() const noexcept {}
+        };
+
+        return Awaiter{ *this };
+    }
+};
+
+class TaskPromiseBase
+{
+public:
+    std::coroutine_handle<> Continuation = std::noop_coroutine();
+    std::exception_ptr Exception;
+
+    //resumes the awaiting coroutine when the task completes
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept { return handle.promise().Continuation; }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { Exception = std::current_exception(); }
+};
+
+// Lazy coroutine, starts when awaited and resumes the awaiting one on completion
+template <typename T = void>
+class Task
+{
+public:
+    struct promise_type : TaskPromiseBase
+    {
+        std::optional<T> Value;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_value(T value) { Value = std::move(value); }
+    };
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting)
+    {
+        handle.promise().Continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume()
+    {
+        if (handle.promise().Exception)
+            std::rethrow_exception(handle.promise().Exception);
+
+        return std::move(*handle.promise().Value);
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+};
+
+template <>
+class Task<void>
+{
+public:
+    struct promise_type : TaskPromiseBase
+    {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_void() {}
+    };
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting)
+    {
+        handle.promise().Continuation = awaiting;
+        return handle;
+    }
+
+    void await_resume()
+    {
+        if (handle.promise().Exception)
+            std::rethrow_exception(handle.promise().Exception);
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+};
+
+// Fire-and-forget owner of a task, the frame frees itself on completion
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+
+        void unhandled_exception()
+        {
+            try
+            {
+                throw;
+            }
+            catch (const std::exception& ex)
+            {
+                LOG_ERROR() << "Coroutine failed with exception: " << ex.what();
+            }
+            catch (...)
+            {
+                LOG_ERROR() << "Coroutine failed with unknown exception";
+            }
+        }
+    };
+};
+
+inline DetachedTask Spawn(Task<void> task)
+{
+    co_await task;
+}
+
+// Serializes coroutines: the work between Lock and the end of the guard runs for one coroutine at a time,
+// the others wait in arrival order. Nobody blocks, a waiting coroutine is suspended.
+class Strand
+{
+public:
+    class Guard
+    {
+    public:
+        explicit Guard(Strand* strand) : strand(strand) {}
+        Guard(Guard&& other) noexcept : strand(std::exchange(other.strand, nullptr)) {}
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        ~Guard()
+        {
+            if (strand)
+                strand->unlock();
+        }
+
+    private:
+        Strand* strand;
+    };
+
+    //co_await strand.Lock(executor) continues on the executor once the earlier holders are done
+    auto Lock(IExecutor& executor)
+    {
+        struct Awaiter
+        {
+            Strand& strand;
+            IExecutor& executor;
+
+            bool await_ready() const noexcept { return false; }
+
+            //false - the strand is free, continue right away
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                std::lock_guard<std::mutex> guard(strand.mutex);
+
+                if (!strand.busy)
+                {
+                    strand.busy = true;
+                    return false;
+                }
+
+                strand.waiters.push_back({ &executor, handle });
+                return true;
+            }
+
+            Guard await_resume() { return Guard(&strand); }
+        };
+
+        return Awaiter{ *this, executor };
+    }
+
+private:
+    std::mutex mutex;
+    bool busy = false;
+    std::deque<std::pair<IExecutor*, std::coroutine_handle<>>> waiters;
+
+    //the strand stays busy and goes to the next waiter
+    void unlock()
+    {
+        std::pair<IExecutor*, std::coroutine_handle<>> next;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+
+            if (waiters.empty())
+            {
+                busy = false;
+                return;
+            }
+
+            next = waiters.front();
+            waiters.pop_front();
+        }
+
+        next.first->Post(next.second);
+    }
+};
+
+// Delays for coroutines. Nothing sleeps: the waiting coroutine is suspended and
+// the owner's loop calls Poll() to hand expired ones back to their executors.
+class TimerQueue
+{
+public:
+    class DelayAwaiter
+    {
+    public:
+        DelayAwaiter(TimerQueue& timers, IExecutor& executor, std::chrono::steady_clock::time_point deadline) :
+            timers(timers),
+            executor(executor),
+            deadline(deadline),
+            cancelled(false){}
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> awaiting)
+        {
+            handle = awaiting;
+            return timers.add(this);
+        }
+
+        //false when the delay was cancelled by shutdown
+        bool await_resume() const noexcept { return !cancelled; }
+
+    private:
+        friend class TimerQueue;
+
+        TimerQueue& timers;
+        IExecutor& executor;
+        std::chrono::steady_clock::time_point deadline;
+        std::coroutine_handle<> handle;
+        bool cancelled;
+    };
+
+    DelayAwaiter Delay(IExecutor& executor, UINT milliseconds)
+    {
+        return DelayAwaiter(*this, executor, std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds));
+    }
+
+    void Poll()
+    {
+        auto now = std::chrono::steady_clock::now();
+
+        std::vector<DelayAwaiter*> expired;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            while (!pending.empty() && pending.top()->deadline <= now)
+            {
+                expired.push_back(pending.top());
+                pending.pop();
+            }
+        }
+
+        for (auto awaiter : expired)
+            awaiter->executor.Post(awaiter->handle);
+    }
+
+    //resumes all waiting coroutines as cancelled, new delays are cancelled right away until Restart
+    void Cancel()
+    {
+        std::vector<DelayAwaiter*> cancelled;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            stopped = true;
+            while (!pending.empty())
+            {
+                cancelled.push_back(pending.top());
+                pending.pop();
+            }
+        }
+
+        for (auto awaiter : cancelled)
+        {
+            awaiter->cancelled = true;
+            awaiter->executor.Post(awaiter->handle);
+        }
+    }
+
+    void Restart()
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopped = false;
+    }
+
+private:
+    struct Later
+    {
+        bool operator()(const DelayAwaiter* left, const DelayAwaiter* right) const { return left->deadline > right->deadline; }
+    };
+
+    std::mutex mutex;
+    std::priority_queue<DelayAwaiter*, std::vector<DelayAwaiter*>, Later> pending;
+    bool stopped = false;
+
+    //false resumes the coroutine at once
+    bool add(DelayAwaiter* awaiter)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        if (stopped)
+        {
+            awaiter->cancelled = true;
+            return false;
+        }
+
+        pending.push(awaiter);
+        return true;
+    }
+};
@@ -0,0 +1,196 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include "Models/GapEventLayout.h"
+#include <mutex>
+
+// Append-only store of handled gaps: fixed-size records in memory-mapped files, one file per day of the trade server time.
+// The mapping grows by doubling the file, GapLockerCli reads the files while they are written.
+class GapEventStore
+{
+public:
+    enum { INITIAL_CAPACITY = 4096 };
+
+    GapEventStore() :
+        file(INVALID_HANDLE_VALUE),
+        mapping(NULL),
+        header(nullptr),
+        capacity(0),
+        partitionDay(0){}
+
+    ~GapEventStore()
+    {
+        close();
+    }
+
+    GapEventStore(const GapEventStore&) = delete;
+    GapEventStore& operator=(const GapEventStore&) = delete;
+
+    //empty directory disables the store
+    void Configure(const std::string& eventDirectory)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        if (directory == eventDirectory)
+            return;
+
+        close();
+        directory = eventDirectory;
+    }
+
+    void Append(const GapEventRecord& record)
+    {
+        METHOD_BEGIN();
+
+        std::lock_guard<std::mutex> guard(mutex);
+
+        if (directory.empty())
+            return;
+
+        INT64 day = record.OpenTime / MILLISECONDS_IN_DAY;
+        if ((header == nullptr || day != partitionDay) && !openPartition(day))
+            return;
+
+        UINT64 count = header->Count.load(std::memory_order_relaxed);
+        if (count == capacity && !map(capacity * 2))
+        {
+            //the old view is gone, the partition is reopened with the next record
+            close();
+            return;
+        }
+
+        records()[count] = record;
+        header->Count.store(count + 1, std::memory_order_release);
+
+        METHOD_END();
+    }
+
+private:
+    enum : INT64 { MILLISECONDS_IN_DAY = SECONDS_IN_DAY * 1000LL };
+
+    std::mutex mutex;
+    std::string directory;
+    HANDLE file;
+    HANDLE mapping;
+    GapEventFileHeader* header;
+    UINT64 capacity;
+    INT64 partitionDay;
+
+    GapEventRecord* records()
+    {
+        return reinterpret_cast<GapEventRecord*>(reinterpret_cast<char*>(header) + sizeof(GapEventFileHeader));
+    }
+
+    bool openPartition(INT64 day)
+    {
+        close();
+
+        boost::filesystem::create_directories(directory);
+
+        time_t start = static_cast<time_t>(day * SECONDS_IN_DAY);
+        char name[32];
+        strftime(name, sizeof(name), GAP_EVENT_FILE_PREFIX "%Y%m%d" GAP_EVENT_FILE_EXTENSION, gmtime(&start));
+        auto path = (boost::filesystem::path(directory) / name).string();
+
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            DWORD error = GetLastError();
+            LOG_ERROR() << "Cannot open gap event file " << path << ", error = " << error
+                << (error == ERROR_SHARING_VIOLATION ? ", it is used by another instance. Gap events are not recorded" : "");
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size))
+            size.QuadPart = 0;
+
+        bool existing = size.QuadPart >= static_cast<INT64>(sizeof(GapEventFileHeader));
+        UINT64 fileCapacity = existing ? (size.QuadPart - sizeof(GapEventFileHeader)) / sizeof(GapEventRecord) : 0;
+
+        if (!map(std::max<UINT64>(fileCapacity, INITIAL_CAPACITY)))
+        {
+            close();
+            return false;
+        }
+
+        if (!existing)
+        {
+            header->Magic = GapEventFileHeader::MAGIC;
+            header->Version = GapEventFileHeader::VERSION;
+            header->HeaderSize = sizeof(GapEventFileHeader);
+            header->RecordSize = sizeof(GapEventRecord);
+            header->PartitionStart = start;
+            header->Count.store(0, std::memory_order_release);
+        }
+        else if (header->Magic != GapEventFileHeader::MAGIC || header->RecordSize != sizeof(GapEventRecord) || header->Count.load() > fileCapacity)
+        {
+            LOG_ERROR() << "File " << path << " is not a gap event file of this version. Gap events are not recorded";
+            close();
+            return false;
+        }
+
+        partitionDay = day;
+        LOG_FILE() << "Gap events are recorded to " << path;
+        return true;
+    }
+
+    //maps the file with room for the capacity, extending it if needed
+    bool map(UINT64 newCapacity)
+    {
+        UINT64 bytes = sizeof(GapEventFileHeader) + newCapacity * sizeof(GapEventRecord);
+
+        HANDLE newMapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, static_cast<DWORD>(bytes >> 32), static_cast<DWORD>(bytes), NULL);
+        if (newMapping == NULL)
+        {
+            LOG_ERROR() << "Cannot map gap event file, error = " << GetLastError();
+            return false;
+        }
+
+        auto view = static_cast<GapEventFileHeader*>(MapViewOfFile(newMapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes));
+        if (view == nullptr)
+        {
+            LOG_ERROR() << "Cannot map gap event file view, error = " << GetLastError();
+            CloseHandle(newMapping);
+            return false;
+        }
+
+        unmap();
+        mapping = newMapping;
+        header = view;
+        capacity = newCapacity;
+        return true;
+    }
+
+    void unmap()
+    {
+        if (header != nullptr)
+            UnmapViewOfFile(header);
+
+        if (mapping != NULL)
+            CloseHandle(mapping);
+
+        header = nullptr;
+        mapping = NULL;
+        capacity = 0;
+    }
+
+    void close()
+    {
+        unmap();
+
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+
+        file = INVALID_HANDLE_VALUE;
+        partitionDay = 0;
+    }
+};
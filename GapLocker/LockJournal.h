@@ -0,0 +1,234 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include "Models/JournalRecord.h"
+#include <condition_variable>
+#include <mutex>
+#include <set>
+
+// Append-only write-ahead journal of lock events.
+// Append only buffers a record; Commit makes everything appended so far durable. Concurrent commits
+// are grouped: one caller writes and flushes the whole batch, the others wait for it.
+// Once no event is open and the file has grown past COMPACT_SIZE it is truncated, so it doesn't grow forever.
+// Without a file (journal disabled) records are dropped, event IDs are still issued.
+class LockJournal
+{
+public:
+    enum { COMPACT_SIZE = 1024 * 1024 };
+
+    LockJournal() :
+        file(INVALID_HANDLE_VALUE),
+        nextEventId(0),
+        appended(0),
+        durable(0),
+        flushing(false),
+        openEvents(0),
+        size(0){}
+
+    ~LockJournal()
+    {
+        Close();
+    }
+
+    LockJournal(const LockJournal&) = delete;
+    LockJournal& operator=(const LockJournal&) = delete;
+
+    //reads the records left by the previous run, a torn tail is cut off
+    bool Open(const std::string& path, std::vector<JournalRecord>& records)
+    {
+        METHOD_BEGIN();
+
+        std::lock_guard<std::mutex> guard(mutex);
+
+        if (file != INVALID_HANDLE_VALUE)
+            return true;
+
+        auto directory = boost::filesystem::path(path).parent_path();
+        if (!directory.empty())
+            boost::filesystem::create_directories(directory);
+
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            DWORD error = GetLastError();
+            LOG_ERROR() << "Cannot open lock journal " << path << ", error = " << error
+                << (error == ERROR_SHARING_VIOLATION ? ", it is used by another instance. Locks are not journaled" : "");
+            return false;
+        }
+
+        JournalRecord record;
+        DWORD read = 0;
+        while (ReadFile(file, &record, sizeof(record), &read, NULL) && read == sizeof(record) && record.IsValid())
+        {
+            records.push_back(record);
+        }
+
+        size = records.size() * sizeof(JournalRecord);
+
+        LARGE_INTEGER position;
+        position.QuadPart = size;
+        if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN) || !SetEndOfFile(file))
+        {
+            LOG_ERROR() << "Cannot truncate lock journal " << path << ", error = " << GetLastError();
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+            return false;
+        }
+
+        //events of the previous run stay open until recovery ends them
+        std::set<UINT64> unfinished;
+        UINT64 lastEventId = 0;
+        for (const auto& r : records)
+        {
+            if (r.Type == JournalRecord::EVENT_BEGIN)
+                unfinished.insert(r.EventId);
+            else if (r.Type == JournalRecord::EVENT_END)
+                unfinished.erase(r.EventId);
+
+            lastEventId = std::max(lastEventId, r.EventId);
+        }
+
+        openEvents = unfinished.size();
+        nextEventId = std::max<UINT64>({ nextEventId.load(), lastEventId + 1, firstEventId() });
+
+        LOG_FILE() << "Lock journal " << path << " opened: " << records.size() << " records, " << openEvents << " unfinished lock events";
+        return true;
+
+        METHOD_END();
+    }
+
+    void Close()
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+
+        if (!pending.empty())
+            write(pending);
+
+        pending.clear();
+        durable = appended;
+
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+
+    //unique across restarts, part of the external IDs of lock orders
+    UINT64 NextEventId()
+    {
+        UINT64 expected = 0;
+        nextEventId.compare_exchange_strong(expected, firstEventId());
+
+        return nextEventId++;
+    }
+
+    //returns the sequence to commit, 0 when the journal is disabled
+    UINT64 Append(JournalRecord record)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        if (file == INVALID_HANDLE_VALUE)
+            return 0;
+
+        if (record.Type == JournalRecord::EVENT_BEGIN)
+            openEvents++;
+        else if (record.Type == JournalRecord::EVENT_END && openEvents > 0)
+            openEvents--;
+
+        record.Checksum = record.ComputeChecksum();
+        pending.push_back(record);
+
+        return ++appended;
+    }
+
+    //waits until the records up to the sequence are on disk
+    void Commit(UINT64 sequence)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (file != INVALID_HANDLE_VALUE && durable < sequence)
+        {
+            if (flushing)
+            {
+                flushed.wait(lock);
+                continue;
+            }
+
+            //this caller writes the batch of everyone who appended so far
+            flushing = true;
+            std::vector<JournalRecord> batch;
+            batch.swap(pending);
+            UINT64 last = appended;
+
+            lock.unlock();
+            write(batch);
+            lock.lock();
+
+            durable = last;
+            flushing = false;
+
+            if (openEvents == 0 && pending.empty() && size >= COMPACT_SIZE)
+                truncate();
+
+            flushed.notify_all();
+        }
+    }
+
+private:
+    HANDLE file;
+    std::atomic<UINT64> nextEventId;
+
+    std::mutex mutex;
+    std::condition_variable flushed;
+    std::vector<JournalRecord> pending;
+    UINT64 appended;
+    UINT64 durable;
+    bool flushing;
+    size_t openEvents;
+    UINT64 size;
+
+    static UINT64 firstEventId()
+    {
+        //microseconds of the start, so IDs of a new run don't repeat those of the old one
+        return static_cast<UINT64>(_time64(nullptr)) * 1000000;
+    }
+
+    void write(const std::vector<JournalRecord>& batch)
+    {
+        if (batch.empty())
+            return;
+
+        DWORD bytes = static_cast<DWORD>(batch.size() * sizeof(JournalRecord));
+        DWORD written = 0;
+
+        if (!WriteFile(file, batch.data(), bytes, &written, NULL) || written != bytes)
+        {
+            LOG_ERROR() << "Cannot write " << batch.size() << " records to lock journal, error = " << GetLastError();
+            return;
+        }
+
+        size += written;
+
+        if (!FlushFileBuffers(file))
+            LOG_ERROR() << "Cannot flush lock journal, error = " << GetLastError();
+    }
+
+    void truncate()
+    {
+        LARGE_INTEGER position;
+        position.QuadPart = 0;
+        if (SetFilePointerEx(file, position, NULL, FILE_BEGIN) && SetEndOfFile(file))
+            size = 0;
+        else
+            LOG_ERROR() << "Cannot compact lock journal, error = " << GetLastError();
+    }
+};
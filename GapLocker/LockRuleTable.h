@@ -0,0 +1,238 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include "Models/LockRule.h"
+#include "Models/Gap.h"
+#include "Symbol.h"
+
+// Lock rules compiled into a dense table indexed by (group ID, symbol ID, position side),
+// so the rule of each position is found with one lookup.
+class LockRuleTable
+{
+public:
+    enum { SIDES = 2 };
+
+    static LockRuleTable Compile(IMTServerAPI* serverApi, const std::string& groupsMask, const std::vector<std::shared_ptr<Symbol>>& symbols, const std::vector<LockRuleSource>& rules)
+    {
+        METHOD_BEGIN();
+
+        LockRuleTable table;
+        table.symbolCount = symbols.size();
+
+        //only groups enabled by the global mask get an ID
+        WIMTConGroup group(serverApi);
+        for (UINT pos = 0; serverApi->GroupNext(pos, group) == MT_RET_OK; pos++)
+        {
+            std::string name = pluginbase::tools::WideToString(group->Group());
+            if (MatchMask(name, groupsMask))
+            {
+                table.groups.push_back(name);
+                table.wideGroups.push_back(group->Group());
+            }
+        }
+
+        //symbol defaults
+        table.cells.resize(table.groups.size() * table.symbolCount * SIDES);
+        for (size_t g = 0; g < table.groups.size(); g++)
+        {
+            for (size_t s = 0; s < table.symbolCount; s++)
+            {
+                for (UINT side = 0; side < SIDES; side++)
+                {
+                    auto& cell = table.cells[table.index(g, s, side)];
+                    cell.Enabled = true;
+                    cell.Points = symbols[s]->Points;
+                }
+            }
+        }
+
+        //rules in configuration order, masks are matched once per group and symbol
+        for (const auto& rule : rules)
+        {
+            std::vector<size_t> ruleGroups;
+            for (size_t g = 0; g < table.groups.size(); g++)
+            {
+                if (MatchMask(table.groups[g], rule.GroupMask))
+                    ruleGroups.push_back(g);
+            }
+
+            std::vector<size_t> ruleSymbols;
+            for (size_t s = 0; s < table.symbolCount; s++)
+            {
+                if (MatchMask(symbols[s]->Name, rule.SymbolMask))
+                    ruleSymbols.push_back(s);
+            }
+
+            for (auto g : ruleGroups)
+            {
+                for (auto s : ruleSymbols)
+                {
+                    for (UINT side = 0; side < SIDES; side++)
+                    {
+                        if (rule.PositionAction.has_value() && *rule.PositionAction != side)
+                            continue;
+
+                        auto& cell = table.cells[table.index(g, s, side)];
+                        cell.Enabled = rule.Enabled;
+                        cell.Points = rule.Points;
+                    }
+                }
+            }
+        }
+
+        //smallest threshold per symbol and side decides whether a gap needs locking at all
+        table.minPoints.assign(table.symbolCount * SIDES, std::nullopt);
+        for (size_t g = 0; g < table.groups.size(); g++)
+        {
+            for (size_t s = 0; s < table.symbolCount; s++)
+            {
+                for (UINT side = 0; side < SIDES; side++)
+                {
+                    const auto& cell = table.cells[table.index(g, s, side)];
+                    auto& points = table.minPoints[s * SIDES + side];
+                    if (cell.Enabled && (!points.has_value() || cell.Points < *points))
+                        points = cell.Points;
+                }
+            }
+        }
+
+        LOG_FILE() << "Lock rules compiled: " << rules.size() << " rules, " << table.groups.size() << " groups, " << table.symbolCount << " symbols";
+
+        return table;
+
+        METHOD_END();
+    }
+
+    const LockRule& Find(size_t groupId, size_t symbolId, UINT positionAction) const
+    {
+        static const LockRule disabled;
+
+        if (groupId >= groups.size() || symbolId >= symbolCount || positionAction >= SIDES)
+            return disabled;
+
+        return cells[index(groupId, symbolId, positionAction)];
+    }
+
+    bool IsEnabled(size_t groupId, size_t symbolId) const
+    {
+        for (UINT side = 0; side < SIDES; side++)
+        {
+            if (Find(groupId, symbolId, side).Enabled)
+                return true;
+        }
+
+        return false;
+    }
+
+    //whether the gap reaches the threshold of at least one enabled cell of the symbol
+    bool IsLockable(const Gap& gap, size_t symbolId) const
+    {
+        if (symbolId >= symbolCount)
+            return false;
+
+        for (UINT side = 0; side < SIDES; side++)
+        {
+            const auto& points = minPoints[symbolId * SIDES + side];
+            if (points.has_value() && gap.LockPrice(side, *points).has_value())
+                return true;
+        }
+
+        return false;
+    }
+
+    size_t GroupTotal() const
+    {
+        return groups.size();
+    }
+
+    const std::string& GroupName(size_t groupId) const
+    {
+        return groups[groupId];
+    }
+
+    LPCWSTR WideGroupName(size_t groupId) const
+    {
+        return wideGroups[groupId].c_str();
+    }
+
+    //MT5 style mask list: comma separated, '*' and '?' wildcards, '!' excludes
+    static bool MatchMask(const std::string& value, const std::string& masks)
+    {
+        bool matched = false;
+
+        std::vector<std::string> arr;
+        boost::split(arr, masks, [](char c) { return c == ','; });
+        for (auto& mask : arr)
+        {
+            boost::trim(mask);
+            if (mask.empty())
+                continue;
+
+            if (mask[0] == '!')
+            {
+                if (matchWildcard(value.c_str(), mask.c_str() + 1))
+                    return false;
+            }
+            else if (matchWildcard(value.c_str(), mask.c_str()))
+            {
+                matched = true;
+            }
+        }
+
+        return matched;
+    }
+
+private:
+    std::vector<std::string> groups;
+    std::vector<std::wstring> wideGroups;
+    size_t symbolCount = 0;
+    std::vector<LockRule> cells;
+    std::vector<std::optional<int>> minPoints;
+
+    size_t index(size_t groupId, size_t symbolId, UINT positionAction) const
+    {
+        return (groupId * symbolCount + symbolId) * SIDES + positionAction;
+    }
+
+    static bool matchWildcard(const char* value, const char* mask)
+    {
+        const char* star = nullptr;
+        const char* resume = nullptr;
+
+        while (*value)
+        {
+            if (*mask == '*')
+            {
+                star = mask++;
+                resume = value;
+            }
+            else if (*mask == '?' || tolower((unsigned char)*mask) == tolower((unsigned char)*value))
+            {
+                mask++;
+                value++;
+            }
+            else if (star)
+            {
+                mask = star + 1;
+                value = ++resume;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        while (*mask == '*')
+            mask++;
+
+        return *mask == 0;
+    }
+};
@@ -0,0 +1,288 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include "Coroutines.h"
+#include "AllocationTracker.h"
+#include "MpmcRing.h"
+#include "StatsSegment.h"
+#include "Tracer.h"
+#include "WorkerPool.h"
+#include "Models/LockRequest.h"
+#include <bit>
+
+// Lock worker threads.
+// Gaps come from OnTick through a lock-free ring of fixed-size requests, so the tick thread never allocates or locks.
+// Coroutine continuations of lock events run in priority order instead of FIFO. New requests go first: they only
+// run up to their first co_await Schedule(), which puts them among the continuations by priority.
+// Idle workers sleep on a semaphore, producers only release it when somebody sleeps.
+class LockScheduler
+{
+public:
+    enum { REQUEST_CAPACITY = 1024, IDLE_WAIT_IN_MILLISECONDS = 100 };
+    typedef std::function<void(const LockRequest&)> RequestHandler;
+
+    LockScheduler(const std::wstring& name, const StatsSegment& stats, RequestHandler handler) :
+        name(name),
+        stats(stats),
+        handler(std::move(handler)),
+        sequence(0),
+        wakeup(CreateSemaphoreW(NULL, 0, LONG_MAX, NULL)),
+        pending(0),
+        sleepers(0),
+        stopping(false){}
+
+    ~LockScheduler()
+    {
+        Stop();
+        CloseHandle(wakeup);
+    }
+
+    LockScheduler(const LockScheduler&) = delete;
+    LockScheduler& operator=(const LockScheduler&) = delete;
+
+    //0 threads - one per core of the affinity mask, 0 mask - any core
+    void Start(size_t threadCount, UINT64 affinity)
+    {
+        METHOD_BEGIN();
+
+        if (!threads.empty())
+            return;
+
+        if (threadCount == 0)
+            threadCount = affinity != 0 ? std::popcount(affinity) : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+        stopping = false;
+
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            threads.emplace_back([this, affinity, i]() { run(affinity, i); });
+        }
+
+        LOG_FILE() << "Pool '" << pluginbase::tools::WideToString(name) << "' started with " << threadCount << " threads, affinity mask 0x" << std::hex << affinity << std::dec;
+
+        METHOD_END();
+    }
+
+    //runs the requests and continuations already queued before the threads exit
+    void Stop()
+    {
+        stopping = true;
+
+        if (!threads.empty())
+            ReleaseSemaphore(wakeup, static_cast<LONG>(threads.size()), NULL);
+
+        for (auto& thread : threads)
+            thread.join();
+
+        threads.clear();
+    }
+
+    //called from OnTick, false when the queue is full and the request is dropped
+    bool Submit(const LockRequest& request)
+    {
+        if (!requests.TryPush(request))
+        {
+            stats.Add(&StatsLayout::RequestsDropped);
+            return false;
+        }
+
+        stats.Add(&StatsLayout::RequestsQueued);
+        stats.Add(&StatsLayout::QueueDepth, 1);
+
+        wake();
+        return true;
+    }
+
+    //lower runs first
+    void Post(std::coroutine_handle<> handle, INT64 priority)
+    {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            ready.push({ priority, sequence++, handle });
+        }
+
+        stats.Add(&StatsLayout::ReadyDepth, 1);
+
+        wake();
+    }
+
+private:
+    struct Entry
+    {
+        INT64 Priority;
+        UINT64 Sequence;    //FIFO among equal priorities
+        std::coroutine_handle<> Handle;
+    };
+
+    struct Later
+    {
+        bool operator()(const Entry& left, const Entry& right) const
+        {
+            return left.Priority != right.Priority ? left.Priority > right.Priority : left.Sequence > right.Sequence;
+        }
+    };
+
+    const std::wstring name;
+    const StatsSegment& stats;
+    const RequestHandler handler;
+    std::vector<std::thread> threads;
+
+    MpmcRing<LockRequest, REQUEST_CAPACITY> requests;
+
+    std::mutex mutex;
+    std::priority_queue<Entry, std::vector<Entry>, Later> ready;
+    UINT64 sequence;
+
+    //a worker counts itself among the sleepers before it checks for work, a producer counts its work before it
+    //checks for sleepers, so at least one of them sees the other and no work is left with every worker asleep
+    HANDLE wakeup;
+    std::atomic<INT64> pending;         //requests and continuations not taken yet, below zero for a moment when taken before counted
+    std::atomic<UINT32> sleepers;
+    std::atomic<bool> stopping;
+
+    void wake()
+    {
+        pending++;
+
+        if (sleepers > 0)
+            ReleaseSemaphore(wakeup, 1, NULL);
+    }
+
+    void run(UINT64 affinity, size_t index)
+    {
+        WorkerPool::Pin(affinity);
+        WorkerPool::Describe(name + L" " + std::to_wstring(index));
+
+        while (true)
+        {
+            if (runRequest() || runReady())
+                continue;
+
+            if (stopping)
+                return;
+
+            //a release left over from an earlier wake only costs an extra pass
+            sleepers++;
+            if (pending <= 0 && !stopping)
+                WaitForSingleObject(wakeup, IDLE_WAIT_IN_MILLISECONDS);
+            sleepers--;
+        }
+    }
+
+    bool runRequest()
+    {
+        LockRequest request;
+        if (!requests.TryPop(request))
+            return false;
+
+        pending--;
+
+        INT64 latency = Tracer::Now() - request.Queued;
+        stats.Add(&StatsLayout::QueueDepth, -1);
+        stats.Add(&StatsLayout::QueueLatencyTotal, static_cast<UINT64>(std::max<INT64>(latency, 0)));
+        stats.Max(&StatsLayout::QueueLatencyMax, latency);
+
+        AllocationTracker::ResetThreadScope();
+        execute(request);
+        AllocationTracker::ResetThreadScope();
+        return true;
+    }
+
+    bool runReady()
+    {
+        std::coroutine_handle<> handle;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (ready.empty())
+                return false;
+
+            handle = ready.top().Handle;
+            ready.pop();
+        }
+
+        pending--;
+        stats.Add(&StatsLayout::ReadyDepth, -1);
+
+        AllocationTracker::ResetThreadScope();
+        resume(handle);
+        AllocationTracker::ResetThreadScope();
+        return true;
+    }
+
+    void execute(const LockRequest& request)
+    {
+        SAFE_BEGIN_NAME(LockScheduler_request) handler(request); SAFE_END();
+    }
+
+    static void resume(std::coroutine_handle<> handle)
+    {
+        SAFE_BEGIN_NAME(LockScheduler_resume) handle.resume(); SAFE_END();
+    }
+};
+
+// Executor of one lock event. Its priority is a deadline: the gap time plus the estimated cost of the
+// requests left, so small events overtake big ones at a crowded open, while a big event still wins
+// once it is old enough.
+class LockJob : public IExecutor
+{
+public:
+    enum { REQUEST_COST_IN_MILLISECONDS = 1, SLICE_REQUESTS = 256 };
+
+    LockJob(LockScheduler& scheduler, INT64 gapTime, size_t estimatedRequests) :
+        scheduler(scheduler),
+        gapTime(gapTime),
+        remaining(estimatedRequests),
+        sliceRequests(0),
+        traceId(Tracer::NextAsyncId()){}
+
+    void Post(std::coroutine_handle<> handle) override
+    {
+        scheduler.Post(handle, Priority());
+    }
+
+    //spans of the job's coroutines are traced as async spans with this ID
+    UINT64 TraceId() const
+    {
+        return traceId;
+    }
+
+    INT64 Priority() const
+    {
+        return gapTime + static_cast<INT64>(remaining.load(std::memory_order_relaxed)) * REQUEST_COST_IN_MILLISECONDS;
+    }
+
+    void SetRemaining(size_t requests)
+    {
+        remaining.store(requests, std::memory_order_relaxed);
+    }
+
+    //counts a finished request, true when the slice is over and the job should co_await Schedule()
+    //to let more urgent events run
+    bool Complete()
+    {
+        size_t left = remaining.load(std::memory_order_relaxed);
+        if (left > 0)
+            remaining.store(left - 1, std::memory_order_relaxed);
+
+        if (++sliceRequests < SLICE_REQUESTS)
+            return false;
+
+        sliceRequests = 0;
+        return true;
+    }
+
+private:
+    LockScheduler& scheduler;
+    const INT64 gapTime;    //msc
+    std::atomic<size_t> remaining;
+    size_t sliceRequests;   //only touched by the job's own coroutine
+    const UINT64 traceId;
+};
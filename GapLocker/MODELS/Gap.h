@@ -0,0 +1,37 @@
+#pragma once
+#include "stdafx.h"
+
+struct Gap
+{
+    MTTickShort Open;       //first tick of the new session
+    MTTickShort Close;      //last tick of the previous session
+    double Point;
+
+    Gap(const MTTickShort& open, const MTTickShort& close, double point) :
+        Open(open),
+        Close(close),
+        Point(point){}
+
+    //price of the lock order for a position with the given action, none when the gap is below the threshold
+    std::optional<double> LockPrice(UINT positionAction, int points) const
+    {
+        //buy positions are locked by sell at bid, sell positions by buy at ask
+        if (positionAction == IMTPosition::EnPositionAction::POSITION_BUY)
+            return lockPrice(Open.bid, Close.bid, points);
+
+        if (positionAction == IMTPosition::EnPositionAction::POSITION_SELL)
+            return lockPrice(Open.ask, Close.ask, points);
+
+        return std::nullopt;
+    }
+
+private:
+    std::optional<double> lockPrice(double open, double close, int points) const
+    {
+        const auto threshold = points * Point;
+        if (std::abs(close - open) < threshold)
+            return std::nullopt;
+
+        return close > open ? close - threshold : close + threshold;
+    }
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+// Shared with external readers, so only system headers here
+#include <windows.h>
+#include <atomic>
+
+#define GAP_EVENT_FILE_PREFIX "GapEvents-"     //GapEvents-YYYYMMDD.dat, one partition per day of the open, in trade server time
+#define GAP_EVENT_FILE_EXTENSION ".dat"
+
+// Header of a gap event partition, followed by RecordSize-sized records.
+// The writer fills a record first and then publishes it by incrementing Count.
+struct GapEventFileHeader
+{
+    enum : UINT32 { MAGIC = 0x54564547, VERSION = 1 };     //'GEVT'
+
+    UINT32 Magic;
+    UINT32 Version;
+    UINT32 HeaderSize;
+    UINT32 RecordSize;
+    INT64 PartitionStart;           //start of the day, trade server time like the tick times
+    std::atomic<UINT64> Count;
+    UINT64 Reserved[4];
+};
+
+// One handled gap
+struct GapEventRecord
+{
+    wchar_t Symbol[32];
+    UINT64 EventId;                 //lock journal event, 0 - nothing was locked
+    INT64 CloseTime;                //msc of trade server time, last tick of the previous session
+    INT64 OpenTime;                 //msc of trade server time, first tick of the new session
+    double CloseBid;
+    double CloseAsk;
+    double OpenBid;
+    double OpenAsk;
+    double Point;
+    double BuyLockPrice;            //price of BUY lock orders (they lock sell positions, ask based) at the symbol points, 0 - below threshold
+    double SellLockPrice;           //price of SELL lock orders (they lock buy positions, bid based) at the symbol points, 0 - below threshold
+    INT64 LatencyMicroseconds;      //from the gap tick to the end of locking
+    UINT32 Positions;
+    UINT32 Orders;
+    UINT32 Deals;
+    UINT32 Fixed;                   //1 - positions of all locked logins were fixed
+    UINT64 Reserved[3];
+};
+
+static_assert(sizeof(GapEventFileHeader) == 64, "Gap event layout is shared with readers");
+static_assert(sizeof(GapEventRecord) == 192, "Gap event layout is shared with readers");
@@ -0,0 +1,48 @@
+#pragma once
+#include "stdafx.h"
+
+//fixed-size entry of the lock journal, acks refer to the intent by event ID and position ticket
+struct JournalRecord
+{
+    enum EnType : UINT32
+    {
+        EVENT_BEGIN = 1,
+        LOCK_INTENT = 2,        //order about to be submitted for the position
+        ORDER_ADDED = 3,        //Ticket - order
+        DEAL_ADDED = 4,         //Ticket - deal
+        POSITIONS_FIXED = 5,    //Login
+        EVENT_END = 6
+    };
+
+    UINT32 Type = 0;
+    UINT32 Checksum = 0;
+    UINT64 EventId = 0;
+    UINT64 Login = 0;
+    UINT64 Position = 0;
+    UINT64 Ticket = 0;
+    INT64 Time = 0;             //lock time, msc
+    double Price = 0;
+    UINT64 Volume = 0;
+    double RateProfit = 0;
+
+    //FNV-1a over the record with an empty checksum, detects torn writes
+    UINT32 ComputeChecksum() const
+    {
+        JournalRecord copy = *this;
+        copy.Checksum = 0;
+
+        UINT32 hash = 2166136261u;
+        auto bytes = reinterpret_cast<const unsigned char*>(&copy);
+        for (size_t i = 0; i < sizeof(copy); i++)
+            hash = (hash ^ bytes[i]) * 16777619u;
+
+        return hash;
+    }
+
+    bool IsValid() const
+    {
+        return Type >= EVENT_BEGIN && Type <= EVENT_END && Checksum == ComputeChecksum();
+    }
+};
+
+static_assert(sizeof(JournalRecord) == 72, "Journal records are written to disk as is");
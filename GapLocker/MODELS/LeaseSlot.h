@@ -0,0 +1,14 @@
+#pragma once
+#include "stdafx.h"
+
+// Slot of one GapLocker instance in the partition lease file, the file is an array of them.
+// The slot is free once Expires has passed.
+struct LeaseSlot
+{
+    char Member[40];        //instance name, the consistent hashing key
+    UINT64 Token;           //tells the instance from another one with the same name
+    INT64 Joined;           //unix msc
+    INT64 Expires;          //unix msc, 0 - released
+};
+
+static_assert(sizeof(LeaseSlot) == 64, "Lease slots are shared between instances");
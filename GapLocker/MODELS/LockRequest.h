@@ -0,0 +1,16 @@
+#pragma once
+#include "stdafx.h"
+
+// Gap handed from OnTick to the lock workers. Fixed size and trivially copyable, so queuing it never allocates.
+// The symbol goes by name: IDs are only valid within one settings version, and settings may be reloaded meanwhile.
+struct LockRequest
+{
+    char Symbol[32];
+    MTTickShort Open;       //first tick of the new session
+    MTTickShort Close;      //last tick of the previous session
+    double Point;
+    INT64 Time;             //msc of the gap
+    INT64 Queued;           //Tracer::Now() of OnTick
+};
+
+static_assert(std::is_trivially_copyable_v<LockRequest>, "Lock requests are copied into the queue as is");
@@ -0,0 +1,19 @@
+#pragma once
+#include "stdafx.h"
+
+//resolved rule for one (group, symbol, position side) cell
+struct LockRule
+{
+    bool Enabled = false;
+    int Points = 0;
+};
+
+//rule as configured, later rules override earlier ones
+struct LockRuleSource
+{
+    std::string GroupMask;
+    std::string SymbolMask;
+    std::optional<UINT> PositionAction;   //none - both sides
+    int Points = 0;
+    bool Enabled = true;
+};
@@ -2,14 +2,35 @@
 
 #include "stdafx.h"
 #include "Symbol.h"
+#include "Models/LockRule.h"
+#include "LockRuleTable.h"
 
 struct PluginSettings
 {
     std::string Groups;
-    std::map<std::string, std::shared_ptr<Symbol>> Symbols;
+    std::map<std::string, std::shared_ptr<Symbol>, std::less<>> Symbols;
+    std::vector<std::shared_ptr<Symbol>> SymbolsById;
     std::vector<boost::gregorian::greg_weekday> SkipDays;
+    std::vector<LockRuleSource> Rules;
+
+    LockRuleTable RuleTable;
 
     //needed?
     std::string Status;
     bool DebugLogs = false;
+    std::string TraceDir;   //empty - tracing disabled
+    bool AllocationTracking = false;
+    std::string GapEventDir;    //empty - gap events are not recorded, a <member> subdirectory when partitioned
+    std::string JournalPath;    //empty - no lock journal, opened on start only, <name>.<member><extension> when partitioned
+
+    //symbols split between instances, applied on start only
+    std::string PartitionLeaseFile;     //empty - this instance locks every symbol
+    std::string PartitionMember;        //the plugin config name when not set
+
+    //thread topology, applied on start only
+    UINT LockThreads = 0;           //0 - one per core of the mask
+    UINT64 LockAffinity = 0;        //0 - any core
+    UINT BackgroundThreads = 0;
+    UINT64 BackgroundAffinity = 0;
+    UINT64 ServiceAffinity = 0;
 };
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+// Shared with external readers, so only system headers here
+#include <windows.h>
+#include <atomic>
+
+#define STATS_SEGMENT_PREFIX L"Global\\GapLocker.Stats."
+
+// Code paths allocations are attributed to
+enum AllocationScope : UINT32
+{
+    ALLOCATION_OTHER = 0,
+    ALLOCATION_ON_TICK,
+    ALLOCATION_SETTINGS_RELOAD,
+    ALLOCATION_LOCK_POSITIONS,
+    ALLOCATION_LOCK_ORDERS,
+    ALLOCATION_LOCK_DEALS,
+    ALLOCATION_LOCK_FIX,
+    ALLOCATION_SCOPE_TOTAL
+};
+
+// Fixed layout of the shared-memory statistics segment.
+// Fields are only ever appended: a new field bumps VERSION, readers show what fits into Size.
+struct StatsLayout
+{
+    enum : UINT32 { MAGIC = 0x4C504147, VERSION = 3 };     //'GAPL'
+
+    UINT32 Magic;
+    UINT32 Version;
+    UINT32 Size;
+    UINT32 ProcessId;
+    std::atomic<INT64> StartTime;       //unix time
+
+    //counters
+    std::atomic<UINT64> TicksSeen;
+    std::atomic<UINT64> TicksMatched;
+    std::atomic<UINT64> SessionsOpened;
+    std::atomic<UINT64> GapsDetected;
+    std::atomic<UINT64> LockEvents;
+    std::atomic<UINT64> OrdersSubmitted;
+    std::atomic<UINT64> OrdersFailed;
+    std::atomic<UINT64> DealsSubmitted;
+    std::atomic<UINT64> DealsFailed;
+    std::atomic<UINT64> FixesSubmitted;
+    std::atomic<UINT64> FixesFailed;
+    std::atomic<UINT64> Retries;
+
+    //gauges
+    std::atomic<INT64> QueueDepth;
+    std::atomic<INT64> LocksInProgress;
+
+    //allocation tracking, since version 2, zero unless enabled
+    std::atomic<UINT64> AllocationEntries[ALLOCATION_SCOPE_TOTAL];     //times the scope was entered
+    std::atomic<UINT64> AllocationCount[ALLOCATION_SCOPE_TOTAL];
+    std::atomic<UINT64> AllocationBytes[ALLOCATION_SCOPE_TOTAL];
+
+    //lock request queue, since version 3
+    std::atomic<UINT64> RequestsQueued;
+    std::atomic<UINT64> RequestsDropped;                //the queue was full
+    std::atomic<UINT64> QueueLatencyTotal;              //microseconds from OnTick to a lock worker, sum over requests
+    std::atomic<INT64> QueueLatencyMax;
+    std::atomic<INT64> ReadyDepth;                      //continuations waiting for a lock worker
+};
+
+static_assert(std::atomic<UINT64>::is_always_lock_free && std::atomic<INT64>::is_always_lock_free, "Stats counters must be lock-free to live in shared memory");
+static_assert(std::is_standard_layout_v<StatsLayout>, "Stats layout must be standard layout");
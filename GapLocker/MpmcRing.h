@@ -0,0 +1,117 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+
+// Bounded lock-free multi-producer multi-consumer queue of trivially copyable records.
+// Each cell carries a sequence number telling whose turn it is, so producers and consumers
+// only contend on the cell they claimed. Storage is part of the object, nothing is allocated.
+template <typename T, size_t CAPACITY>
+class MpmcRing
+{
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>, "Records are copied in and out of the cells");
+
+public:
+    MpmcRing() :
+        enqueuePosition(0),
+        dequeuePosition(0)
+    {
+        for (size_t i = 0; i < CAPACITY; i++)
+            cells[i].Sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpmcRing(const MpmcRing&) = delete;
+    MpmcRing& operator=(const MpmcRing&) = delete;
+
+    //false when the queue is full
+    bool TryPush(const T& value)
+    {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            Cell& cell = cells[position & MASK];
+            size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (difference == 0)
+            {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.Value = value;
+                    cell.Sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                //the cell still holds the record of the previous lap
+                return false;
+            }
+            else
+            {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //false when the queue is empty
+    bool TryPop(T& value)
+    {
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            Cell& cell = cells[position & MASK];
+            size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+            if (difference == 0)
+            {
+                if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = cell.Value;
+                    cell.Sequence.store(position + CAPACITY, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //approximate while producers or consumers are running
+    size_t Size() const
+    {
+        size_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+        size_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+private:
+    enum : size_t { MASK = CAPACITY - 1, CACHE_LINE = 64 };
+
+    struct alignas(CACHE_LINE) Cell
+    {
+        std::atomic<size_t> Sequence;
+        T Value;
+    };
+
+    Cell cells[CAPACITY];
+    alignas(CACHE_LINE) std::atomic<size_t> enqueuePosition;
+    alignas(CACHE_LINE) std::atomic<size_t> dequeuePosition;
+};
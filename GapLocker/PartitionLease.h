@@ -0,0 +1,332 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include "PartitionRing.h"
+#include "Models/LeaseSlot.h"
+#include "Models/PluginSettings.h"
+#include <chrono>
+#include <mutex>
+#include <random>
+
+// Splits the configured symbols between GapLocker instances sharing a local lease file.
+// Each instance renews its slot in the file every RENEW_INTERVAL, the live slots make the ring that decides
+// which instance locks a symbol. An instance which stops releases its slot, one which dies loses it when
+// the lease expires, and its symbols move to the others.
+// Once configured, an instance without a valid lease owns nothing, so two instances never lock the same symbol.
+class PartitionLease
+{
+public:
+    enum { SLOT_COUNT = 64, RENEW_INTERVAL_IN_MILLISECONDS = 1000, LEASE_IN_MILLISECONDS = 10 * 1000 };
+
+    //a new member counts for the others after JOIN_DELAY and for itself two renewals later,
+    //so the old owner of a symbol gives it up before the new one takes it
+    enum { JOIN_DELAY_IN_MILLISECONDS = 2 * RENEW_INTERVAL_IN_MILLISECONDS, SELF_JOIN_DELAY_IN_MILLISECONDS = JOIN_DELAY_IN_MILLISECONDS + 2 * RENEW_INTERVAL_IN_MILLISECONDS };
+
+    PartitionLease() :
+        file(INVALID_HANDLE_VALUE),
+        token(0),
+        slot(SLOT_COUNT),
+        self(SIZE_MAX),
+        leaseExpires(0),
+        leaseDeadline(0),
+        lastOwned(SIZE_MAX){}
+
+    ~PartitionLease()
+    {
+        Close();
+    }
+
+    PartitionLease(const PartitionLease&) = delete;
+    PartitionLease& operator=(const PartitionLease&) = delete;
+
+    //the file is opened and the slot taken by Renew
+    bool Open(const std::string& leasePath, const std::string& memberName)
+    {
+        METHOD_BEGIN();
+
+        std::lock_guard<std::mutex> guard(mutex);
+
+        //the path alone makes the instance partitioned: without a member name it never joins and owns nothing
+        path = leasePath;
+
+        if (memberName.empty() || memberName.size() >= sizeof(LeaseSlot::Member))
+        {
+            LOG_ERROR() << "Partition member name '" << memberName << "' must be 1 to " << sizeof(LeaseSlot::Member) - 1 << " characters. Symbols are not locked";
+            return false;
+        }
+
+        member = memberName;
+
+        std::random_device random;
+        token = (static_cast<UINT64>(random()) << 32 | random()) | 1;
+
+        LOG_FILE() << "Symbols are partitioned through lease file " << path << " as member '" << member << "'";
+        return true;
+
+        METHOD_END();
+    }
+
+    //releases the slot, its symbols move to the other members on their next renewal
+    void Close()
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            if (slot < SLOT_COUNT && lockFile())
+            {
+                LeaseSlot own;
+                if (readSlot(slot, own) && own.Token == token)
+                {
+                    own.Expires = 0;
+                    writeSlot(slot, own);
+                }
+
+                unlockFile();
+            }
+
+            CloseHandle(file);
+        }
+
+        file = INVALID_HANDLE_VALUE;
+        path.clear();
+        member.clear();
+        slot = SLOT_COUNT;
+        members.clear();
+        ring = PartitionRing();
+        self = SIZE_MAX;
+        leaseExpires = 0;
+        leaseDeadline = 0;
+        lastOwned = SIZE_MAX;
+    }
+
+    //renews the slot and refreshes the members, called by the service thread
+    void Renew()
+    {
+        METHOD_BEGIN();
+
+        std::lock_guard<std::mutex> guard(mutex);
+
+        if (path.empty() || member.empty() || !openFile() || !lockFile())
+            return;
+
+        BOOST_SCOPE_EXIT_ALL(&) { unlockFile(); };
+
+        std::vector<LeaseSlot> slots(SLOT_COUNT);
+        if (!readSlots(slots))
+            return;
+
+        const INT64 now = currentTime();
+        const UINT64 steadyNow = GetTickCount64();
+
+        //our own slot only while it is live, after a lapse the instance joins anew
+        size_t own = SLOT_COUNT, free = SLOT_COUNT;
+        bool duplicate = false;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            bool live = slots[i].Expires > now;
+
+            if (live && slots[i].Token == token)
+                own = i;
+            else if (live && member == memberOf(slots[i]))
+                duplicate = true;
+            else if (!live && free == SLOT_COUNT)
+                free = i;
+        }
+
+        if (own == SLOT_COUNT)
+        {
+            if (duplicate || free == SLOT_COUNT)
+            {
+                LOG_ERROR() << (duplicate ? "Another instance is running as partition member '" : "Lease file is full, cannot join as partition member '") << member << "'. Symbols are not locked";
+                leaseExpires = 0;
+                leaseDeadline = 0;
+                return;
+            }
+
+            own = free;
+            ZeroMemory(&slots[own], sizeof(LeaseSlot));
+            strncpy_s(slots[own].Member, member.c_str(), _TRUNCATE);
+            slots[own].Token = token;
+            slots[own].Joined = now;
+
+            LOG_FILE() << "Joined the partition as member '" << member << "'";
+        }
+
+        slots[own].Expires = now + LEASE_IN_MILLISECONDS;
+        if (!writeSlot(own, slots[own]))
+            return;
+
+        slot = own;
+        leaseExpires = slots[own].Expires;
+        leaseDeadline = steadyNow + LEASE_IN_MILLISECONDS;
+
+        //with nobody else to take symbols from, the instance counts at once
+        bool alone = std::none_of(slots.begin(), slots.end(), [&](const LeaseSlot& other) { return other.Expires > now && other.Token != token; });
+
+        std::vector<std::string> counted;
+        for (const auto& other : slots)
+        {
+            INT64 delay = other.Token != token ? JOIN_DELAY_IN_MILLISECONDS : alone ? 0 : SELF_JOIN_DELAY_IN_MILLISECONDS;
+            if (other.Expires > now && now >= other.Joined + delay)
+                counted.push_back(memberOf(other));
+        }
+
+        std::sort(counted.begin(), counted.end());
+        counted.erase(std::unique(counted.begin(), counted.end()), counted.end());
+
+        if (counted != members)
+        {
+            members = std::move(counted);
+            ring = PartitionRing(members);
+
+            auto found = std::find(members.begin(), members.end(), member);
+            self = found != members.end() ? static_cast<size_t>(found - members.begin()) : SIZE_MAX;
+            lastOwned = SIZE_MAX;
+        }
+
+        METHOD_END();
+    }
+
+    //marks the symbols this instance owns until the lease expires, ticks check the deadline themselves
+    void Apply(const PluginSettings& settings)
+    {
+        METHOD_BEGIN();
+
+        std::lock_guard<std::mutex> guard(mutex);
+
+        const bool partitioned = !path.empty();
+        const bool valid = self != SIZE_MAX && currentTime() < leaseExpires;
+
+        size_t owned = 0;
+        for (const auto& [name, symbol] : settings.Symbols)
+        {
+            bool owner = !partitioned || (valid && ring.Owner(name) == self);
+            symbol->State->OwnedUntil.store(!owner ? 0 : partitioned ? leaseDeadline : UINT64_MAX, std::memory_order_release);
+
+            if (owner)
+                owned++;
+        }
+
+        if (partitioned && owned != lastOwned)
+        {
+            lastOwned = owned;
+            LOG_FILE() << "Partition member '" << member << "' owns " << owned << " of " << settings.Symbols.size() << " symbols, members: " << boost::algorithm::join(members, ", ");
+        }
+
+        METHOD_END();
+    }
+
+private:
+    std::mutex mutex;
+    std::string path;
+    std::string member;
+    HANDLE file;
+    UINT64 token;
+    size_t slot;                        //SLOT_COUNT - none yet
+
+    std::vector<std::string> members;   //sorted, counted ones only
+    PartitionRing ring;
+    size_t self;                        //index among the members, SIZE_MAX - not counted yet
+    INT64 leaseExpires;
+    UINT64 leaseDeadline;               //GetTickCount64 time of leaseExpires, the wall clock may jump
+    size_t lastOwned;
+
+    //the name isn't terminated when it fills the field
+    static std::string memberOf(const LeaseSlot& source)
+    {
+        return std::string(source.Member, strnlen(source.Member, sizeof(source.Member)));
+    }
+
+    static INT64 currentTime()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    bool openFile()
+    {
+        if (file != INVALID_HANDLE_VALUE)
+            return true;
+
+        auto directory = boost::filesystem::path(path).parent_path();
+        if (!directory.empty())
+            boost::filesystem::create_directories(directory);
+
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            LOG_ERROR() << "Cannot open lease file " << path << ", error = " << GetLastError();
+            return false;
+        }
+
+        return true;
+    }
+
+    //the lock is held across read and write, so instances update the file one at a time
+    bool lockFile()
+    {
+        OVERLAPPED overlapped = {};
+        if (!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &overlapped))
+        {
+            LOG_ERROR() << "Cannot lock lease file, error = " << GetLastError();
+            return false;
+        }
+
+        return true;
+    }
+
+    void unlockFile()
+    {
+        OVERLAPPED overlapped = {};
+        UnlockFileEx(file, 0, MAXDWORD, MAXDWORD, &overlapped);
+    }
+
+    //a new file reads as free slots
+    bool readSlots(std::vector<LeaseSlot>& slots)
+    {
+        DWORD bytes = static_cast<DWORD>(slots.size() * sizeof(LeaseSlot));
+        DWORD read = 0;
+
+        OVERLAPPED overlapped = {};
+        if (!ReadFile(file, slots.data(), bytes, &read, &overlapped) && GetLastError() != ERROR_HANDLE_EOF)
+        {
+            LOG_ERROR() << "Cannot read lease file, error = " << GetLastError();
+            return false;
+        }
+
+        ZeroMemory(reinterpret_cast<char*>(slots.data()) + read, bytes - read);
+        return true;
+    }
+
+    bool readSlot(size_t index, LeaseSlot& target)
+    {
+        DWORD read = 0;
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(index * sizeof(LeaseSlot));
+
+        return ReadFile(file, &target, sizeof(target), &read, &overlapped) && read == sizeof(target);
+    }
+
+    bool writeSlot(size_t index, const LeaseSlot& source)
+    {
+        DWORD written = 0;
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(index * sizeof(LeaseSlot));
+
+        if (!WriteFile(file, &source, sizeof(source), &written, &overlapped) || written != sizeof(source))
+        {
+            LOG_ERROR() << "Cannot write lease file, error = " << GetLastError();
+            return false;
+        }
+
+        return true;
+    }
+};
@@ -0,0 +1,67 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+
+// Consistent hashing of symbol names onto instances.
+// Each member puts VIRTUAL_NODES points on the ring and a symbol belongs to the first point after its hash,
+// so a member joining or leaving only moves its own share of symbols.
+class PartitionRing
+{
+public:
+    enum { VIRTUAL_NODES = 64 };
+
+    PartitionRing(){}
+
+    //members in the same order on every instance, so ties resolve the same way
+    explicit PartitionRing(const std::vector<std::string>& members)
+    {
+        for (size_t member = 0; member < members.size(); member++)
+        {
+            for (size_t node = 0; node < VIRTUAL_NODES; node++)
+                points.push_back({ Hash(members[member] + "#" + std::to_string(node)), member });
+        }
+
+        std::sort(points.begin(), points.end());
+    }
+
+    bool IsEmpty() const
+    {
+        return points.empty();
+    }
+
+    //index of the owner among the members, the ring must not be empty
+    size_t Owner(std::string_view key) const
+    {
+        auto point = std::lower_bound(points.begin(), points.end(), std::make_pair(Hash(key), size_t(0)));
+        return point != points.end() ? point->second : points.front().second;
+    }
+
+    static UINT64 Hash(std::string_view key)
+    {
+        //FNV-1a, then a finalizer, so similar names (EURUSD, EURUSD.m) land far from each other
+        UINT64 hash = 14695981039346656037ULL;
+        for (char c : key)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+private:
+    std::vector<std::pair<UINT64, size_t>> points;
+};
@@ -12,11 +12,23 @@
 #include "pluginbase/license.h"
 #include "pluginbase/mt5Plugin.h"
 #include "SettingsReader.h"
+#include "Tracer.h"
+#include "StatsSegment.h"
+#include "TextConverter.h"
+#include "Coroutines.h"
+#include "AllocationTracker.h"
+#include "LockJournal.h"
+#include "LockScheduler.h"
+#include "GapEventStore.h"
+#include "WorkerPool.h"
+#include "PartitionLease.h"
+#include "Published.h"
 
 // Need to subscribe/unsubscribe for each interface with IMTServerAPI::TickSubscribe / IMTServerAPi::TickUnsubscribe in CPluginInstance::Start() and CPluginInstance::Stop()
 class CPluginInstance : public pluginbase::Mt5Plugin,
     public IMTServerPlugin,
     public IMTConPluginSink,
+    public IMTConGroupSink,
     public IMTTickSink
 {
 
@@ -25,20 +37,43 @@ private:
     MTServerInfo    serverInfo;
     CMTThread         thread;
 
-    pluginbase::Threadpool< std::function<void()> > threadPool;
+    //must outlive the pool jobs which update it
+    StatsSegment stats;
+
+    //the rest of the work (backfill, trace files) doesn't compete with locking for threads, each may get its own cores
+    mutable WorkerPool backgroundPool;
+
+    //lock workflows run as coroutines on the lock workers in priority order, retry backoff suspends them instead of sleeping
+    mutable LockScheduler scheduler;
+    mutable TimerQueue timers;
+    mutable std::atomic<int> activeWorkflows;
+    mutable LockJournal journal;
+    mutable GapEventStore gapEvents;
+
+    //symbols split with other instances, renewed by the service thread
+    PartitionLease partition;
 
     std::atomic<bool> isThreadActive;
+    std::atomic<bool> groupsChanged;
+    UINT64 serviceAffinity = 0;
 
-    PluginSettings pluginSettings;
+    //replaced as a whole on reload, so OnTick can read it without the plugin lock
+    Published<PluginSettings> pluginSettings;
 
     enum { LOOP_DELAY_IN_MILLISECONDS = 50, TIMEOUT_CHECK_STATE = 50, MILLISECONDS_IN_SEC = 1000 };
+    enum { LOCK_WINDOW_IN_SECONDS = SECONDS_IN_MINUTE * 10, STOP_TIMEOUT_IN_MILLISECONDS = 30 * MILLISECONDS_IN_SEC };
+    enum { BACKFILL_MAX_WORKERS = 16, BACKFILL_FIRST_WINDOW_IN_SECONDS = SECONDS_IN_HOUR, BACKFILL_MAX_WINDOW_IN_SECONDS = SECONDS_IN_DAY, BACKFILL_DEPTH_IN_SECONDS = SECONDS_IN_DAY * 7 };
 
     MUTEX();
 
 public:
     CPluginInstance() :
         serverApi(nullptr),
-        threadPool([](const std::function<void()>& F) { SAFE_BEGIN_NAME(Threadpool_handler_func) F(); SAFE_END(); })
+        pluginSettings(std::make_shared<PluginSettings>()),
+        backgroundPool(L"GapLocker background"),
+        scheduler(L"GapLocker lock", stats, [this](const LockRequest& request) { startLockEvent(request); }),
+        activeWorkflows(0),
+        groupsChanged(false)
     {
         SAFE_BEGIN_ALWAYS();
         ZeroMemory(&serverInfo, sizeof(serverInfo));
@@ -83,11 +118,25 @@ public:
                 throw std::exception("Cannot get server info", retcode);
             }
 
+            //stats are named after the plugin config, so several configs of the plugin don't collide
+            WIMTConPlugin plugin(serverApi);
+            if ((retcode = serverApi->PluginCurrent(plugin)) != MT_RET_OK)
+            {
+                throw std::exception("Cannot get current plugin", retcode);
+            }
+
+            stats.Open(plugin->Name());
+
             if ((retcode = serverApi->PluginSubscribe(this)) != MT_RET_OK)
             {
                 throw std::exception("Cannot subscribe for plugin updates", retcode);
             }
 
+            if ((retcode = serverApi->GroupSubscribe(this)) != MT_RET_OK)
+            {
+                throw std::exception("Cannot subscribe for group updates", retcode);
+            }
+
             if ((retcode = serverApi->TickSubscribe(this)) != MT_RET_OK)
             {
                 throw std::exception("Cannot subscribe for tick updates", retcode);
@@ -119,6 +168,7 @@ public:
             ThreadStop();
 
             serverApi->PluginUnsubscribe(this);
+            serverApi->GroupUnsubscribe(this);
             serverApi->TickUnsubscribe(this);
 
             serverApi = nullptr;
@@ -148,13 +198,37 @@ public:
             return (retcode);
         }
         
-        if (LOCK(); !SettingsReader::Read(serverApi, pluginSettings))
         {
-            return (MT_RET_ERR_PARAMS);
+            TRACE_LOCK();
+            if (!reloadSettings())
+            {
+                return (MT_RET_ERR_PARAMS);
+            }
+        }
+
+        //thread topology and the journal path are applied on start only
+        auto settings = pluginSettings.Share();
+        backgroundPool.Start(settings->BackgroundThreads, settings->BackgroundAffinity);
+        serviceAffinity = settings->ServiceAffinity;
+
+        //journal records are recovered once the loop runs
+        std::vector<JournalRecord> journalRecords;
+        if (!settings->JournalPath.empty())
+            journal.Open(settings->JournalPath, journalRecords);
+
+        if (!settings->PartitionLeaseFile.empty())
+        {
+            partition.Open(settings->PartitionLeaseFile, settings->PartitionMember);
+            partition.Renew();
+            partition.Apply(*settings);
         }
 
         LOG_FILE() << "Thread-loop starting...";
         isThreadActive = true;
+        timers.Restart();
+
+        //the workers start only once the plugin is active, gaps seen by OnTick meanwhile wait for them in the queue
+        scheduler.Start(settings->LockThreads, settings->LockAffinity);
 
         if (!thread.Start(&ThreadWrapper, this, 64 * 1024))
         {
@@ -162,6 +236,11 @@ public:
             return(MT_RET_ERROR);
         }
 
+        backfillSessionEnds();
+
+        if (!journalRecords.empty())
+            Spawn(recoverLockEvents(std::move(journalRecords)));
+
         return MT_RET_OK;
 
         METHOD_END();
@@ -176,66 +255,99 @@ public:
             return;
         }
             
-        LOCK();
-        SettingsReader::Read(serverApi, pluginSettings);
+        TRACE_LOCK();
+        reloadSettings();
 
         SAFE_END();
     }
 
+    //group IDs of the rule table are taken from the server group list, the service thread recompiles it
+    void OnGroupAdd(const IMTConGroup* group) override
+    {
+        groupsChanged = true;
+    }
+
+    void OnGroupUpdate(const IMTConGroup* group) override
+    {
+        groupsChanged = true;
+    }
+
+    void OnGroupDelete(const IMTConGroup* group) override
+    {
+        groupsChanged = true;
+    }
+
     void OnTick(
         LPCWSTR symbol,
         const MTTickShort& tick
     ) override
     {
         SAFE_BEGIN();
-        LOCK();
-        
-        std::string s = pluginbase::tools::WideToString(symbol);
-        auto symbolObj = pluginSettings.Symbols.find(s);
-        if (symbolObj == pluginSettings.Symbols.end())
+        TRACE_SPAN("OnTick");
+        ALLOC_SCOPE(ALLOCATION_ON_TICK);
+        stats.Add(&StatsLayout::TicksSeen);
+
+        //registered reader for the call, a replaced snapshot is not freed while it runs
+        auto settings = pluginSettings.Read();
+
+        NarrowBuffer buffer;
+        auto s = TextConverter::ToNarrow(symbol, buffer);
+        auto symbolObj = settings->Symbols.find(s);
+        if (symbolObj == settings->Symbols.end())
             return;
 
-        auto smb = symbolObj->second;
+        stats.Add(&StatsLayout::TicksMatched);
 
-        time_t currentSessionStart = smb->GetStartTimeWithOffset(tick.datetime);
-        time_t currentSessionEnd = smb->GetEndTimeWithOffset(currentSessionStart);
+        const auto& smb = symbolObj->second;
 
-        if (currentSessionStart > tick.datetime)
-        {
-            currentSessionStart -= SECONDS_IN_DAY;
-            currentSessionEnd -= SECONDS_IN_DAY;
-        }
+        //symbols of other partition members only keep their session markers, so a takeover can lock the next gap
+        const bool owned = smb->State->Owned();
 
-        if (currentSessionStart <= tick.datetime && currentSessionEnd > tick.datetime)
+        time_t currentSessionStart, currentSessionEnd;
+
+        if (smb->GetSession(tick.datetime, currentSessionStart, currentSessionEnd))
         {
-            //check start
-            bool newSession = smb->SessionStartInfo != std::nullopt && smb->SessionStartInfo->datetime < currentSessionStart;
-            if (smb->SessionStartInfo == std::nullopt || newSession)
+            //check start, only the tick which moves the session marker forward opens the session
+            time_t knownSessionStart = smb->State->SessionStart.load(std::memory_order_acquire);
+            if (knownSessionStart < currentSessionStart)
             {
-                if (newSession)
-                    LOG_FILE() << "Current session has ended.";
-
-                smb->SessionStartInfo = tick;
-                LOG_FILE() << "Session Started";
+                //read before the marker moves: ticks which lose it write their own time into SessionEndInfo
+                auto previousClose = smb->State->SessionEndInfo.Read();
 
-                if (tick.datetime <= currentSessionStart + SECONDS_IN_MINUTE * 10 && smb->SessionEndInfo != std::nullopt)
+                if (smb->State->SessionStart.compare_exchange_strong(knownSessionStart, currentSessionStart, std::memory_order_acq_rel))
                 {
-                    std::optional<double> buyPrice = std::nullopt;
-                    std::optional<double> sellPrice = std::nullopt;
+                    if (knownSessionStart != 0)
+                        LOG_FILE() << "Current session has ended.";
+
+                    stats.Add(&StatsLayout::SessionsOpened);
 
-                    getPricesForLockingPosition(smb, buyPrice, sellPrice);
+                    LOG_FILE() << "Session Started";
 
-                    if (buyPrice.has_value() || sellPrice.has_value())
+                    if (owned && tick.datetime <= currentSessionStart + LOCK_WINDOW_IN_SECONDS && previousClose.has_value() && previousClose->datetime < currentSessionStart)
                     {
-                        threadPool.push([this, buyPrice, sellPrice, s, tick]() {
-                            openLockPositions(buyPrice, sellPrice, s, tick.datetime * 1000);
-                            });
+                        auto gap = getGapForLockingPositions(*smb, tick, *previousClose);
+
+                        if (gap.has_value() && settings->RuleTable.IsLockable(*gap, smb->Id))
+                        {
+                            stats.Add(&StatsLayout::GapsDetected);
+
+                            LockRequest request = {};
+                            memcpy(request.Symbol, s.data(), std::min(s.size(), sizeof(request.Symbol) - 1));
+                            request.Open = gap->Open;
+                            request.Close = gap->Close;
+                            request.Point = gap->Point;
+                            request.Time = tick.datetime * 1000;
+                            request.Queued = Tracer::Now();
+
+                            if (!scheduler.Submit(request))
+                                LOG_ERROR() << "Lock queue is full, gap of symbol '" << smb->Name << "' is not locked";
+                        }
                     }
                 }
             }
 
-            //set end
-            smb->SessionEndInfo = tick; 
+            //set end, a tick delivered late doesn't replace a later one
+            smb->State->SessionEndInfo.Write(tick, TickBefore);
         }
 
         SAFE_END();
@@ -243,6 +355,185 @@ public:
 
 private:
 
+    bool reloadSettings()
+    {
+        METHOD_BEGIN();
+        ALLOC_SCOPE(ALLOCATION_SETTINGS_RELOAD);
+
+        auto settings = std::make_shared<PluginSettings>();
+        bool result = SettingsReader::Read(serverApi, *settings);
+
+        //symbols are recreated on each read, carry over their session state
+        auto previous = pluginSettings.Share();
+        for (auto& [name, symbol] : settings->Symbols)
+        {
+            auto old = previous->Symbols.find(name);
+            if (old != previous->Symbols.end())
+                symbol->ShareState(*old->second);
+        }
+
+        partition.Apply(*settings);
+
+        pluginSettings.Store(settings);
+
+        AllocationTracker::Enable(settings->AllocationTracking);
+
+        gapEvents.Configure(settings->GapEventDir);
+
+        //applying settings also flushes spans collected so far
+        Tracer::Instance().Configure(settings->TraceDir);
+        Tracer::Instance().Flush();
+
+        return result;
+
+        METHOD_END();
+    }
+
+    //new snapshot with the rules compiled against the current server groups, the rest is shared
+    void recompileRules()
+    {
+        METHOD_BEGIN();
+        TRACE_LOCK();
+
+        auto settings = std::make_shared<PluginSettings>(*pluginSettings.Share());
+        settings->RuleTable = LockRuleTable::Compile(serverApi, settings->Groups, settings->SymbolsById, settings->Rules);
+        pluginSettings.Store(settings);
+
+        METHOD_END();
+    }
+
+    //restores the last close of each symbol from the server tick history, so the first open after restart can be locked;
+    //runs on the background pool, so startup doesn't wait for the history requests
+    void backfillSessionEnds()
+    {
+        METHOD_BEGIN();
+
+        struct Backfill
+        {
+            std::vector<std::shared_ptr<Symbol>> Symbols;
+            INT64 Now = 0;
+            size_t ProgressStep = 1;
+            std::atomic<size_t> Next = 0;
+            std::atomic<size_t> Done = 0;
+            std::atomic<size_t> Restored = 0;
+            std::atomic<size_t> Running = 0;
+        };
+
+        auto backfill = std::make_shared<Backfill>();
+
+        auto settings = pluginSettings.Share();
+        for (const auto& [name, symbol] : settings->Symbols)
+        {
+            if (!symbol->State->SessionEndInfo.HasValue())
+                backfill->Symbols.push_back(symbol);
+        }
+
+        if (backfill->Symbols.empty())
+            return;
+
+        const size_t total = backfill->Symbols.size();
+        const size_t workers = std::min<size_t>(total, std::clamp<size_t>(std::thread::hardware_concurrency(), 1, BACKFILL_MAX_WORKERS));
+        backfill->Now = serverApi->TimeCurrent();
+        backfill->ProgressStep = std::max<size_t>(total / 10, 1);
+        backfill->Running = workers;
+
+        LOG_FILE() << "Backfilling last session close for " << total << " symbols with " << workers << " workers...";
+
+        //each worker pulls the next symbol, so concurrency is bounded by the number of workers
+        for (size_t i = 0; i < workers; i++)
+        {
+            backgroundPool.Push([this, backfill, total]() {
+                for (size_t index = backfill->Next++; index < total && isThreadActive; index = backfill->Next++)
+                {
+                    if (backfillSessionEnd(*backfill->Symbols[index], backfill->Now))
+                        backfill->Restored++;
+
+                    size_t completed = ++backfill->Done;
+                    if (completed % backfill->ProgressStep == 0 || completed == total)
+                        LOG_FILE() << "Backfill progress: " << completed << "/" << total;
+                }
+
+                if (--backfill->Running == 0)
+                    LOG_FILE() << "Backfill finished, restored last close for " << backfill->Restored << " of " << total << " symbols";
+                });
+        }
+
+        METHOD_END();
+    }
+
+    bool backfillSessionEnd(Symbol& symbol, INT64 now) const
+    {
+        METHOD_BEGIN();
+
+        LPCWSTR name = symbol.WideName.c_str();
+        time_t sessionStart, sessionEnd;
+        INT64 boundary = now;
+
+        if (symbol.GetSession(now, sessionStart, sessionEnd))
+        {
+            //too late to lock this open, the live ticks will record the close for the next one
+            if (now > sessionStart + LOCK_WINDOW_IN_SECONDS)
+                return false;
+
+            //the session may have been opened before restart, don't open it twice
+            MTTickShort* ticks = nullptr;
+            UINT total = 0;
+            if (serverApi->TickHistoryGet(name, sessionStart, now, ticks, total) == MT_RET_OK && ticks != nullptr)
+            {
+                BOOST_SCOPE_EXIT_ALL(&) { serverApi->Free(ticks); };
+
+                if (total > 0)
+                {
+                    time_t knownSessionStart = 0;
+                    symbol.State->SessionStart.compare_exchange_strong(knownSessionStart, sessionStart);
+
+                    LOG_FILE() << "Session for symbol '" << symbol.Name << "' has been already started, skip backfill";
+                    return false;
+                }
+            }
+
+            boundary = sessionStart;
+        }
+
+        //look back with growing windows until the last in-session tick is found, a window never asks for more than a session
+        for (INT64 window = BACKFILL_FIRST_WINDOW_IN_SECONDS, to = boundary; to > boundary - BACKFILL_DEPTH_IN_SECONDS;
+            to -= window, window = std::min<INT64>(window * 2, BACKFILL_MAX_WINDOW_IN_SECONDS))
+        {
+            MTTickShort* ticks = nullptr;
+            UINT total = 0;
+            MTAPIRES retcode;
+
+            if ((retcode = serverApi->TickHistoryGet(name, to - window, to - 1, ticks, total)) != MT_RET_OK)
+            {
+                LOG_ERROR() << "Cannot get tick history for symbol '" << symbol.Name << "' from server: " << retcode;
+                return false;
+            }
+
+            if (ticks == nullptr)
+                continue;
+
+            BOOST_SCOPE_EXIT_ALL(&) { serverApi->Free(ticks); };
+
+            for (UINT i = total; i > 0; i--)
+            {
+                const MTTickShort& tick = ticks[i - 1];
+                if (!symbol.GetSession(tick.datetime, sessionStart, sessionEnd))
+                    continue;
+
+                //live ticks are always fresher than history and are kept
+                symbol.State->SessionEndInfo.Write(tick, TickBefore);
+
+                LOG_FILE() << "Restored last close for symbol '" << symbol.Name << "' at " << tick.datetime << ": bid = " << tick.bid << ", ask = " << tick.ask;
+                return true;
+            }
+        }
+
+        LOG_FILE() << "No previous session close has been found for symbol '" << symbol.Name << "'";
+        return false;
+
+        METHOD_END();
+    }
+
     void ThreadStop()
     {
         METHOD_BEGIN();
@@ -252,6 +543,26 @@ private:
         isThreadActive = false;
         thread.Shutdown();
 
+        //wake up waiting lock workflows and let them finish; they give up before their next server call,
+        //so only calls in flight are waited for, and the server API and the workers stay valid until the last one ends
+        timers.Cancel();
+        for (int waited = 0; activeWorkflows > 0; waited += LOOP_DELAY_IN_MILLISECONDS)
+        {
+            if (waited > 0 && waited % STOP_TIMEOUT_IN_MILLISECONDS == 0)
+                LOG_ERROR() << activeWorkflows << " lock workflows are still running, waiting for them";
+
+            MAGIC_SLEEP(LOOP_DELAY_IN_MILLISECONDS);
+        }
+
+        //gaps queued meanwhile are dropped by startLockEvent, the journal is closed only once the workers are gone
+        scheduler.Stop();
+        journal.Close();
+
+        //the other instances take the symbols over on their next renewal
+        partition.Close();
+
+        backgroundPool.Stop();
+
         METHOD_END();
     }
 
@@ -261,6 +572,7 @@ private:
         METHOD_NO_DEADLOCK_NAME(perform_service_loop_worker);
 
         LOG_FILE() << "Starting loop...";
+        WorkerPool::Pin(serviceAffinity);
 
         auto counter = 0;
 
@@ -269,6 +581,21 @@ private:
             counter++;
             MAGIC_SLEEP(LOOP_DELAY_IN_MILLISECONDS);
 
+            timers.Poll();
+            AllocationTracker::Publish(stats);
+            pluginSettings.Reclaim();
+
+            if (groupsChanged.exchange(false))
+            {
+                recompileRules();
+            }
+
+            if (counter % (PartitionLease::RENEW_INTERVAL_IN_MILLISECONDS / LOOP_DELAY_IN_MILLISECONDS) == 0)
+            {
+                partition.Renew();
+                partition.Apply(*pluginSettings.Share());
+            }
+
             //each minute
             if (counter % (1 * 60 * (1000 / TIMEOUT_CHECK_STATE)) == 0)
             {
@@ -293,110 +620,219 @@ private:
         SAFE_END(0);
     }
 
-    void getPricesForLockingPosition(std::shared_ptr<Symbol> symbol, std::optional<double> &buyPrice, std::optional<double> &sellPrice) const
+    std::optional<Gap> getGapForLockingPositions(const Symbol& symbol, const MTTickShort& open, const MTTickShort& close) const
     {
         METHOD_BEGIN();
+        TRACE_SPAN("getGapForLockingPositions");
         
         //get symbol info for digits
         WIMTConSymbol wrapper(serverApi);
         MTAPIRES retcode;
-        if ((retcode = serverApi->SymbolGet(pluginbase::tools::StringToWide(symbol->Name).c_str(), wrapper)) != MT_RET_OK)
+        if ((retcode = serverApi->SymbolGet(symbol.WideName.c_str(), wrapper)) != MT_RET_OK)
         {
-            LOG_ERROR() << "Cannot get symbol '" << symbol->Name <<  "' from server: " << retcode;
-            return;
+            LOG_ERROR() << "Cannot get symbol '" << symbol.Name <<  "' from server: " << retcode;
+            return std::nullopt;
         }
 
-        //check bid for creation lock-buy position
-        double bidOpen = symbol->SessionStartInfo->bid;
-        double bidClose = symbol->SessionEndInfo->bid;
+        return Gap(open, close, wrapper->Point());
+
+        METHOD_END();
+    }
 
-        const auto threshold = symbol->Points * wrapper->Point();
-        if (std::abs(bidClose - bidOpen) >= threshold)
+    //runs on a lock worker for each gap queued by OnTick
+    void startLockEvent(const LockRequest& request) const
+    {
+        if (!isThreadActive)
         {
-            sellPrice = bidClose > bidOpen ? bidClose - threshold : bidClose + threshold;
+            LOG_ERROR() << "Plugin is stopping, the gap of symbol '" << request.Symbol << "' is not locked";
+            return;
         }
 
-        //check ask for creation lock-sell position
-        double askOpen = symbol->SessionStartInfo->ask;
-        double askClose = symbol->SessionEndInfo->ask;
+        auto settings = pluginSettings.Share();
 
-        if (std::abs(askClose - askOpen) >= threshold)
+        auto symbol = settings->Symbols.find(std::string_view(request.Symbol));
+        if (symbol == settings->Symbols.end())
         {
-            buyPrice = askClose > askOpen ? askClose - threshold : askClose + threshold;
+            LOG_ERROR() << "Symbol '" << request.Symbol << "' is not configured anymore, its gap is not locked";
+            return;
         }
-        
-        return;
 
-        METHOD_END();
+        //the lease may lapse while the request waits in the queue
+        if (!symbol->second->State->Owned())
+        {
+            LOG_ERROR() << "Partition lease of symbol '" << request.Symbol << "' has expired, its gap is not locked";
+            return;
+        }
+
+        Spawn(openLockPositions(settings, Gap(request.Open, request.Close, request.Point), symbol->second->Id, request.Time, request.Queued));
     }
 
-    void openLockPositions(std::optional<double> buyPrice, std::optional<double> sellPrice, const std::string& symbol, INT64 time) const
+    Task<> openLockPositions(std::shared_ptr<PluginSettings> settings, Gap gap, size_t symbolId, INT64 time, INT64 detected) const
     {
-        METHOD_BEGIN();
+        //counted before the first suspension, so ThreadStop waits for it
+        activeWorkflows++;
+        BOOST_SCOPE_EXIT_ALL(&) { activeWorkflows--; };
+
+        auto& symbol = *settings->SymbolsById[symbolId];
+
+        //until the positions are counted the size of the previous event is the estimate
+        LockJob job(scheduler, time, symbol.State->LastLockPositions * 2);
+
+        //events of one symbol run one at a time; several workers take requests from the queue, so two events
+        //of one symbol may reach the strand in either order, the order of their gaps is not kept
+        auto strand = co_await symbol.State->LockStrand.Lock(job);
+        co_await job.Schedule();
+
+        //the trace is written after each lock event, events running at the same time share the file
+        BOOST_SCOPE_EXIT_ALL(&) { backgroundPool.Push([]() { Tracer::Instance().Flush(); }); };
+        TRACE_ASYNC_SPAN("openLockPositions", job.TraceId());
+
+        stats.Add(&StatsLayout::LockEvents);
+        stats.Add(&StatsLayout::LocksInProgress, 1);
+        BOOST_SCOPE_EXIT_ALL(&) { stats.Add(&StatsLayout::LocksInProgress, -1); };
+
+        //the event is recorded however it ends
+        GapEventRecord event = gapEventRecord(symbol, gap, time);
+        BOOST_SCOPE_EXIT_ALL(&) {
+            event.LatencyMicroseconds = Tracer::Now() - detected;
+            gapEvents.Append(event);
+        };
+
+        auto positions = getPositionsBySymbol(*settings, symbol);
+        if (!isThreadActive)
+            co_return;
 
-        auto positions = getPositionsBySymbol(symbol);
         if (positions.size() == 0)
         {
             LOG_FILE() << "No opened positions has been found after the gap.";
-            return;
+            co_return;
         }
 
-        LOG_FILE() << "Start creating lock positions for symbol '" << symbol << "' with buyPrice = " << buyPrice.value_or(0.0) << " and sellPrice = " << sellPrice.value_or(0.0);
+        event.Positions = static_cast<UINT32>(positions.size());
+
+        //an order and a deal per position
+        job.SetRemaining(positions.size() * 2);
+        symbol.State->LastLockPositions = positions.size();
+
+        LOG_FILE() << "Start creating lock positions for symbol '" << symbol.Name << "' with close bid/ask = " << gap.Close.bid << "/" << gap.Close.ask
+            << " and open bid/ask = " << gap.Open.bid << "/" << gap.Open.ask;
+
+        //from here the event is journaled, if it is interrupted by stop or crash the recovery on start finishes it
+        const UINT64 eventId = journal.NextEventId();
+        event.EventId = eventId;
+        journal.Append({ .Type = JournalRecord::EVENT_BEGIN, .EventId = eventId, .Time = time });
+        BOOST_SCOPE_EXIT_ALL(&) {
+            if (isThreadActive)
+                journal.Commit(journal.Append({ .Type = JournalRecord::EVENT_END, .EventId = eventId, .Time = time }));
+        };
 
         //create orders
-        auto orders = CreateOrderArray(positions, buyPrice, sellPrice, time);
+        auto orders = co_await CreateOrderArray(job, eventId, positions, gap, time);
+        event.Orders = static_cast<UINT32>(orders.size());
         if (orders.size() == 0)
         {
-            LOG_ERROR() << "No orders for symbol '" << symbol << "' has been created. Skip.";
-            return;
+            LOG_ERROR() << "No orders for symbol '" << symbol.Name << "' has been created. Skip.";
+            co_return;
         }
 
         //create deals
-        CreateDealArray(orders);
+        event.Deals = static_cast<UINT32>(co_await CreateDealArray(job, eventId, orders));
+
+        //stopping, the journal leaves the event open for the recovery on start
+        if (!isThreadActive)
+            co_return;
 
         //fix positions
-        if (!fixPositions(orders))
+        std::set<UINT64> logins;
+        for (const auto& extendedOrder : orders)
         {
-            LOG_ERROR() << "Can't fix positions for symbol '" << symbol << "'. Skip.";
-            return;
+            logins.insert((*extendedOrder.Order)->Login());
         }
 
-        LOG_FILE() << "Creating lock positions for symbol '" << symbol << "' has been finished successfully.";
-            
-        METHOD_END();
+        if (!fixPositions(eventId, logins))
+        {
+            LOG_ERROR() << "Can't fix positions for symbol '" << symbol.Name << "'. Skip.";
+            co_return;
+        }
+
+        event.Fixed = 1;
+        LOG_FILE() << "Creating lock positions for symbol '" << symbol.Name << "' has been finished successfully.";
+    }
+
+    static GapEventRecord gapEventRecord(const Symbol& symbol, const Gap& gap, INT64 time)
+    {
+        GapEventRecord event = {};
+
+        wcsncpy_s(event.Symbol, symbol.WideName.c_str(), _TRUNCATE);
+        event.CloseTime = gap.Close.datetime * 1000;
+        event.OpenTime = time;
+        event.CloseBid = gap.Close.bid;
+        event.CloseAsk = gap.Close.ask;
+        event.OpenBid = gap.Open.bid;
+        event.OpenAsk = gap.Open.ask;
+        event.Point = gap.Point;
+        //sell positions are locked by BUY orders and buy positions by SELL orders
+        event.BuyLockPrice = gap.LockPrice(IMTPosition::EnPositionAction::POSITION_SELL, symbol.Points).value_or(0);
+        event.SellLockPrice = gap.LockPrice(IMTPosition::EnPositionAction::POSITION_BUY, symbol.Points).value_or(0);
+
+        return event;
     }
 
-    std::vector<WIMTPosition> getPositionsBySymbol(const std::string& symbol) const
+    class PositionExtended
+    {
+    public:
+            PositionExtended(IMTServerAPI* serverApi, const IMTPosition* position, const LockRule& rule) :
+                Position(serverApi),
+                Rule(rule)
+            {
+                Position->Assign(position);
+            }
+
+            WIMTPosition Position;
+            LockRule Rule;
+    };
+
+    std::vector<PositionExtended> getPositionsBySymbol(const PluginSettings& settings, const Symbol& symbol) const
     {
         METHOD_BEGIN();
+        TRACE_SPAN("getPositionsBySymbol");
+        ALLOC_SCOPE(ALLOCATION_LOCK_POSITIONS);
 
-        //get open positions by groups
-        WIMTPositionArray allPositions(serverApi);
-        std::vector<WIMTPosition> positions;
-        MTAPIRES retcode;
+        std::vector<PositionExtended> positions;
+        const auto& table = settings.RuleTable;
 
-        std::string groups;
+        //get open positions group by group, so each position gets its rule by group ID
+        for (size_t groupId = 0; groupId < table.GroupTotal() && isThreadActive; groupId++)
         {
-            LOCK();
-            groups = pluginSettings.Groups;
-        }
+            if (!table.IsEnabled(groupId, symbol.Id))
+                continue;
 
-        if ((retcode = serverApi->PositionGetByGroup(pluginbase::tools::StringToWide(groups).c_str(), allPositions)) != MT_RET_OK)
-        {
-            LOG_ERROR() << "Cannot get open positions for group mask '" << groups << "' from server: " << retcode;
-            return positions;
-        }
+            const auto& group = table.GroupName(groupId);
+            WIMTPositionArray allPositions(serverApi);
+            MTAPIRES retcode;
 
-        LOG_FILE() << "Positions detected: " << allPositions->Total();
+            TRACE_SPAN("PositionGetByGroup");
+            if ((retcode = serverApi->PositionGetByGroup(table.WideGroupName(groupId), allPositions)) != MT_RET_OK)
+            {
+                LOG_ERROR() << "Cannot get open positions for group '" << group << "' from server: " << retcode;
+                continue;
+            }
 
-        for (int i = 0; i < allPositions->Total(); i++)
-        {
-            if (pluginbase::tools::WideToString(allPositions->Next(i)->Symbol()) == symbol) 
+            for (UINT i = 0; i < allPositions->Total(); i++)
             {
-                positions.emplace_back(serverApi);
-                positions.back()->Assign(allPositions->Next(i));
+                auto position = allPositions->Next(i);
+                if (!TextConverter::Equals(position->Symbol(), symbol.WideName))
+                    continue;
+
+                const auto& rule = table.Find(groupId, symbol.Id, position->Action());
+                if (!rule.Enabled)
+                    continue;
+
+                positions.emplace_back(serverApi, position, rule);
             }
         }
+
+        LOG_FILE() << "Positions detected: " << positions.size();
       
         return positions;
 
@@ -406,184 +842,481 @@ private:
     class OrderExtended
     {
     public:
-            OrderExtended(const std::shared_ptr<WIMTOrder> order, double rateProfit)
+            OrderExtended(const std::shared_ptr<WIMTOrder> order, UINT64 position, double rateProfit)
             {
                 Order = order;
+                Position = position;
                 RateProfit = rateProfit;
             }
 
             std::shared_ptr<WIMTOrder> Order;
+            UINT64 Position;
             double RateProfit;
     };
 
-    std::vector<OrderExtended> CreateOrderArray(const std::vector<WIMTPosition> &positions, std::optional<double> buyPrice, std::optional<double> sellPrice, INT64 time) const
+    Task<std::vector<OrderExtended>> CreateOrderArray(LockJob& job, UINT64 eventId, const std::vector<PositionExtended> &positions, const Gap& gap, INT64 time) const
     {
-        METHOD_BEGIN();
+        TRACE_ASYNC_SPAN("CreateOrderArray", job.TraceId());
 
         //create orders array
         std::vector<OrderExtended> extendedOrders;
-        IMTOrder::EnOrderType action;
-        double price;
+        UINT64 intents = 0;
 
-        for (const auto& position : positions)
+        for (const auto& extendedPosition : positions)
         {
-            if (position->Action() == IMTPosition::EnPositionAction::POSITION_BUY && sellPrice.has_value())
+            ALLOC_SCOPE(ALLOCATION_LOCK_ORDERS);
+            const auto& position = extendedPosition.Position;
+
+            auto price = gap.LockPrice(position->Action(), extendedPosition.Rule.Points);
+            if (!price.has_value())
             {
-                action = IMTOrder::EnOrderType::OP_SELL;
-                price = sellPrice.value();
+                LOG_FILE() << "Skip creating order for position '" << position->Position() << "' with reason: no price detected.";
+                continue;
             }
-            else if (position->Action() == IMTPosition::EnPositionAction::POSITION_SELL && buyPrice.has_value())
+
+            auto order = createLockOrder(position, *price, position->Volume(), time, lockExternalId(eventId, position->Position()));
+            extendedOrders.emplace_back(order, position->Position(), position->RateProfit());
+
+            intents = journal.Append({ .Type = JournalRecord::LOCK_INTENT, .EventId = eventId, .Login = position->Login(), .Position = position->Position(),
+                .Time = time, .Price = *price, .Volume = position->Volume(), .RateProfit = position->RateProfit() });
+        }
+
+        //one flush for all intents of the event; acks are not waited for, a lost ack is found on the server by external ID
+        journal.Commit(intents);
+
+        std::vector<OrderExtended> createdOrders;
+
+        for (const auto& extendedOrder : extendedOrders)
+        {
+            auto& order = *extendedOrder.Order;
+
+            //try to create on server
+            auto retcode = co_await submitWithRetries(job, "HistoryAdd", [&]() { ALLOC_SCOPE(ALLOCATION_LOCK_ORDERS); return serverApi->HistoryAdd(order); });
+
+            //big events are sliced, so more urgent ones can run in between
+            if (job.Complete())
+                co_await job.Schedule();
+
+            //the scope is thread local, so it is opened only after the last suspension of the iteration
+            ALLOC_SCOPE(ALLOCATION_LOCK_ORDERS);
+            if (retcode == MT_RET_ERR_CANCEL)
             {
-                action = IMTOrder::EnOrderType::OP_BUY;
-                price = buyPrice.value();
+                LOG_ERROR() << "Plugin is stopping. Skip creating orders";
+                break;
             }
-            else
+
+            if (retcode != MT_RET_OK && retcode != MT_RET_OK_NONE)
             {
-                LOG_FILE() << "Skip creating order for position '" << position->Position() << "' with reason: no price detected.";
+                stats.Add(&StatsLayout::OrdersFailed);
+                LOG_ERROR() << "Can't create lock order for position " << extendedOrder.Position << ". Skip creating locking position";
                 continue;
             }
 
-            std::shared_ptr<WIMTOrder> order = std::make_shared<WIMTOrder>(serverApi);
-            (*order)->Login(position->Login());
-            (*order)->Symbol(position->Symbol());
-            (*order)->Type(action);
-            (*order)->Digits(position->Digits());
-            (*order)->DigitsCurrency(position->DigitsCurrency());
-            (*order)->ContractSize(position->ContractSize());
-            (*order)->VolumeInitial(position->Volume());
-            (*order)->VolumeCurrent(0);
-            (*order)->PriceOrder(price);
-            (*order)->PriceCurrent(price);
-            (*order)->PriceSL(0);
-            (*order)->PriceTP(0);
-            (*order)->RateMargin(position->RateMargin());
-            (*order)->TypeFill(IMTOrder::EnOrderFilling::ORDER_FILL_RETURN);
-            (*order)->TimeSetupMsc(time);
-            (*order)->TimeDoneMsc(time);
-            (*order)->ReasonSet(IMTOrder::EnOrderReason::ORDER_REASON_DEALER);
-            (*order)->StateSet(IMTOrder::EnOrderState::ORDER_STATE_FILLED);
-            (*order)->Comment(L"Open Gap");
-            
+            LOG_FILE() << "Locking order " << order->Order() << " for position " << extendedOrder.Position << " has been created";
+            stats.Add(&StatsLayout::OrdersSubmitted);
+            journal.Append({ .Type = JournalRecord::ORDER_ADDED, .EventId = eventId, .Login = order->Login(), .Position = extendedOrder.Position, .Ticket = order->Order() });
+
+            createdOrders.push_back(extendedOrder);
+        }
+
+        co_return createdOrders;
+    }
+
+    Task<size_t> CreateDealArray(LockJob& job, UINT64 eventId, const std::vector<OrderExtended> & extendedOrders) const
+    {
+        TRACE_ASYNC_SPAN("CreateDealArray", job.TraceId());
+        size_t created = 0;
+
+        //create deals
+        for (const auto& extendedOrder : extendedOrders)
+        {
+            const auto& order = *extendedOrder.Order;
+            std::shared_ptr<WIMTDeal> deal;
+            {
+                //the scope is thread local, so it is opened only between suspensions
+                ALLOC_SCOPE(ALLOCATION_LOCK_DEALS);
+                deal = std::make_shared<WIMTDeal>(serverApi);
+                fillLockDeal(*deal, order, extendedOrder.RateProfit);
+            }
+
             //try to create on server
-            int errors = 0;
-            while (errors <= 10)
+            auto retcode = co_await submitWithRetries(job, "DealAdd", [&]() { ALLOC_SCOPE(ALLOCATION_LOCK_DEALS); return serverApi->DealAdd(*deal); });
+
+            if (job.Complete())
+                co_await job.Schedule();
+
+            ALLOC_SCOPE(ALLOCATION_LOCK_DEALS);
+            if (retcode == MT_RET_ERR_CANCEL)
             {
-                MTAPIRES retcode = serverApi->HistoryAdd(*order);
-                if (retcode == MT_RET_ERR_NETWORK || retcode == MT_RET_ERR_FREQUENT || retcode == MT_RET_REQUEST_TOO_MANY || retcode == MT_RET_REQUEST_TIMEOUT)
-                {
-                    //wait 1 sec and just try again
-                    MAGIC_SLEEP(MILLISECONDS_IN_SEC);
-                    errors++;
+                LOG_ERROR() << "Plugin is stopping. Skip creating deals";
+                co_return created;
+            }
+
+            if (retcode != MT_RET_OK && retcode != MT_RET_OK_NONE)
+            {
+                stats.Add(&StatsLayout::DealsFailed);
+                LOG_ERROR() << "Can't create lock deal for order and position " << order->Order() << ". Skip.";
+                continue;
+            }
+
+            LOG_FILE() << "Deal " << (*deal)->Deal() << " with position id " << (*deal)->PositionID() << " has been created";
+            stats.Add(&StatsLayout::DealsSubmitted);
+            journal.Append({ .Type = JournalRecord::DEAL_ADDED, .EventId = eventId, .Login = (*deal)->Login(), .Position = extendedOrder.Position, .Ticket = (*deal)->Deal() });
+            created++;
+        }
+
+        co_return created;
+    }
+
+    std::shared_ptr<WIMTOrder> createLockOrder(const WIMTPosition& position, double price, UINT64 volume, INT64 time, const std::wstring& externalId) const
+    {
+        auto action = position->Action() == IMTPosition::EnPositionAction::POSITION_BUY ? IMTOrder::EnOrderType::OP_SELL : IMTOrder::EnOrderType::OP_BUY;
+
+        std::shared_ptr<WIMTOrder> order = std::make_shared<WIMTOrder>(serverApi);
+        (*order)->Login(position->Login());
+        (*order)->Symbol(position->Symbol());
+        (*order)->Type(action);
+        (*order)->Digits(position->Digits());
+        (*order)->DigitsCurrency(position->DigitsCurrency());
+        (*order)->ContractSize(position->ContractSize());
+        (*order)->VolumeInitial(volume);
+        (*order)->VolumeCurrent(0);
+        (*order)->PriceOrder(price);
+        (*order)->PriceCurrent(price);
+        (*order)->PriceSL(0);
+        (*order)->PriceTP(0);
+        (*order)->RateMargin(position->RateMargin());
+        (*order)->TypeFill(IMTOrder::EnOrderFilling::ORDER_FILL_RETURN);
+        (*order)->TimeSetupMsc(time);
+        (*order)->TimeDoneMsc(time);
+        (*order)->ReasonSet(IMTOrder::EnOrderReason::ORDER_REASON_DEALER);
+        (*order)->StateSet(IMTOrder::EnOrderState::ORDER_STATE_FILLED);
+        (*order)->ExternalID(externalId.c_str());
+        (*order)->Comment(L"Open Gap");
+
+        return order;
+    }
+
+    void fillLockDeal(WIMTDeal& deal, const WIMTOrder& order, double rateProfit) const
+    {
+        deal->Login(order->Login());
+        deal->Symbol(order->Symbol());
+        deal->Action(order->Type());
+        deal->Volume(order->VolumeInitial());
+        deal->Price(order->PriceOrder());
+        deal->Digits(order->Digits());
+        deal->DigitsCurrency(order->DigitsCurrency());
+        deal->ContractSize(order->ContractSize());
+        deal->TimeMsc(order->TimeSetupMsc());
+        deal->RateMargin(order->RateMargin());
+        deal->Order(order->Order());
+        deal->PositionID(order->Order());
+        deal->Entry(IMTDeal::EnDealEntry::ENTRY_OUT);
+        deal->ReasonSet(order->Reason());
+        deal->ExternalID(order->ExternalID());
+        deal->Comment(L"Open Gap");
+        deal->RateProfit(rateProfit);
+    }
+
+    //deterministic for the event and position, so after a crash the lock order is found on the server
+    static std::wstring lockExternalId(UINT64 eventId, UINT64 position)
+    {
+        wchar_t buffer[64];
+        swprintf_s(buffer, L"GL%llX.%llX", eventId, position);
+        return buffer;
+    }
+
+    //calls the server until the request is accepted, MT_RET_ERR_CANCEL when the plugin is stopping
+    template <typename Request>
+    Task<MTAPIRES> submitWithRetries(LockJob& job, const char* name, Request request) const
+    {
+        MTAPIRES retcode = MT_RET_ERROR;
+
+        for (int errors = 0; errors <= 10; errors++)
+        {
+            if (!isThreadActive)
+                co_return MT_RET_ERR_CANCEL;
+
+            {
+                TRACE_SPAN(name);
+                retcode = request();
+            }
+
+            if (retcode == MT_RET_OK || retcode == MT_RET_OK_NONE)
+                co_return retcode;
+
+            if (retcode == MT_RET_ERR_NETWORK || retcode == MT_RET_ERR_FREQUENT || retcode == MT_RET_REQUEST_TOO_MANY || retcode == MT_RET_REQUEST_TIMEOUT)
+            {
+                //wait 1 sec without holding the pool thread and just try again
+                stats.Add(&StatsLayout::Retries);
+                if (!co_await retryDelay(job))
+                    co_return MT_RET_ERR_CANCEL;
+
+                continue;
+            }
+
+            LOG_ERROR() << name << " failed with status " << retcode;
+        }
+
+        co_return retcode;
+    }
+
+    Task<bool> retryDelay(LockJob& job) const
+    {
+        TRACE_ASYNC_SPAN("retry.wait", job.TraceId());
+        co_return co_await timers.Delay(job, MILLISECONDS_IN_SEC);
+    }
+
+    //finishes lock events left open by the previous run; orders and deals which reached the server
+    //before the crash are found there by external ID instead of being created again
+    Task<> recoverLockEvents(std::vector<JournalRecord> records) const
+    {
+        //counted before the first suspension, so ThreadStop waits for it
+        activeWorkflows++;
+        BOOST_SCOPE_EXIT_ALL(&) { activeWorkflows--; };
+
+        //older than any live gap, so it goes first
+        LockJob job(scheduler, 0, 0);
+        co_await job.Schedule();
+        BOOST_SCOPE_EXIT_ALL(&) { backgroundPool.Push([]() { Tracer::Instance().Flush(); }); };
+        TRACE_ASYNC_SPAN("recoverLockEvents", job.TraceId());
+
+        struct PendingLock
+        {
+            JournalRecord Intent;
+            UINT64 Order = 0;
+            UINT64 Deal = 0;
+        };
+
+        struct PendingEvent
+        {
+            INT64 Time = 0;
+            std::map<UINT64, PendingLock> Locks;    //by position
+            std::set<UINT64> FixedLogins;
+        };
+
+        std::map<UINT64, PendingEvent> events;
+        for (const auto& record : records)
+        {
+            if (record.Type == JournalRecord::EVENT_END)
+            {
+                events.erase(record.EventId);
+                continue;
+            }
+
+            auto& event = events[record.EventId];
+            switch (record.Type)
+            {
+            case JournalRecord::EVENT_BEGIN:
+                event.Time = record.Time;
+                break;
+            case JournalRecord::LOCK_INTENT:
+                event.Locks[record.Position].Intent = record;
+                break;
+            case JournalRecord::ORDER_ADDED:
+                event.Locks[record.Position].Order = record.Ticket;
+                break;
+            case JournalRecord::DEAL_ADDED:
+                event.Locks[record.Position].Deal = record.Ticket;
+                break;
+            case JournalRecord::POSITIONS_FIXED:
+                event.FixedLogins.insert(record.Login);
+                break;
+            }
+        }
+
+        if (events.empty())
+            co_return;
+
+        LOG_FILE() << "Recovering " << events.size() << " unfinished lock events...";
+
+        for (auto& [eventId, event] : events)
+        {
+            std::set<UINT64> logins;
+
+            for (auto& [position, lock] : event.Locks)
+            {
+                if (lock.Intent.Type != JournalRecord::LOCK_INTENT)
                     continue;
-                }
 
-                if (retcode != MT_RET_OK && retcode != MT_RET_OK_NONE)
+                if (lock.Order == 0)
+                    lock.Order = co_await recoverOrder(job, eventId, lock.Intent);
+
+                if (lock.Order != 0 && lock.Deal == 0)
+                    lock.Deal = co_await recoverDeal(job, eventId, lock.Intent, lock.Order);
+
+                if (lock.Order != 0 && event.FixedLogins.count(lock.Intent.Login) == 0)
+                    logins.insert(lock.Intent.Login);
+            }
+
+            //stopping again, the rest is left for the next start
+            if (!isThreadActive)
+                co_return;
+
+            if (!fixPositions(eventId, logins))
+                LOG_ERROR() << "Can't fix positions of recovered lock event " << eventId;
+
+            journal.Commit(journal.Append({ .Type = JournalRecord::EVENT_END, .EventId = eventId, .Time = event.Time }));
+            LOG_FILE() << "Lock event " << eventId << " has been recovered";
+        }
+    }
+
+    Task<UINT64> recoverOrder(LockJob& job, UINT64 eventId, JournalRecord intent) const
+    {
+        if (!isThreadActive)
+            co_return 0;
+
+        auto externalId = lockExternalId(eventId, intent.Position);
+        const INT64 time = intent.Time / MILLISECONDS_IN_SEC;
+        std::shared_ptr<WIMTOrder> order;
+
+        {
+            //the scope is thread local, so it is opened only between suspensions
+            ALLOC_SCOPE(ALLOCATION_LOCK_ORDERS);
+
+            //the order may have been created without its ack reaching the journal
+            WIMTOrderArray orders(serverApi);
+            if (serverApi->HistoryGet(intent.Login, time - SECONDS_IN_MINUTE, time + SECONDS_IN_MINUTE, orders) == MT_RET_OK)
+            {
+                for (UINT i = 0; i < orders->Total(); i++)
                 {
-                    LOG_ERROR() << "Problems with creating orders. Status: " << retcode;
-                    errors++;
-                    continue;
+                    auto found = orders->Next(i);
+                    if (!TextConverter::Equals(found->ExternalID(), externalId))
+                        continue;
+
+                    LOG_FILE() << "Locking order " << found->Order() << " for position " << intent.Position << " has been found on server";
+                    journal.Append({ .Type = JournalRecord::ORDER_ADDED, .EventId = eventId, .Login = intent.Login, .Position = intent.Position, .Ticket = found->Order() });
+                    co_return found->Order();
                 }
+            }
 
-                LOG_FILE() << "Locking order " << (*order)->Order() << " for position " << position->Position() << " has been created";
-                extendedOrders.emplace_back(order, position->RateProfit());
-                break;
+            WIMTPosition position(serverApi);
+            MTAPIRES retcode;
+            if ((retcode = serverApi->PositionGetByTicket(intent.Position, position)) != MT_RET_OK)
+            {
+                LOG_FILE() << "Position " << intent.Position << " is not open anymore (" << retcode << "). Skip creating locking position";
+                co_return 0;
             }
 
-            if (errors > 10)
-                LOG_ERROR() << "Can't create lock order for position " << position->Position() << ". Skip creating locking position";
+            order = createLockOrder(position, intent.Price, intent.Volume, intent.Time, externalId);
         }
 
-        return extendedOrders;
+        MTAPIRES retcode = co_await submitWithRetries(job, "HistoryAdd", [&]() { ALLOC_SCOPE(ALLOCATION_LOCK_ORDERS); return serverApi->HistoryAdd(*order); });
 
-        METHOD_END();
+        ALLOC_SCOPE(ALLOCATION_LOCK_ORDERS);
+        if (retcode != MT_RET_OK && retcode != MT_RET_OK_NONE)
+        {
+            if (retcode != MT_RET_ERR_CANCEL)
+                stats.Add(&StatsLayout::OrdersFailed);
+
+            LOG_ERROR() << "Can't create lock order for position " << intent.Position << ". Skip creating locking position";
+            co_return 0;
+        }
+
+        LOG_FILE() << "Locking order " << (*order)->Order() << " for position " << intent.Position << " has been created";
+        stats.Add(&StatsLayout::OrdersSubmitted);
+        journal.Append({ .Type = JournalRecord::ORDER_ADDED, .EventId = eventId, .Login = intent.Login, .Position = intent.Position, .Ticket = (*order)->Order() });
+
+        co_return (*order)->Order();
     }
 
-    void CreateDealArray(const std::vector<OrderExtended> & extendedOrders) const
+    Task<UINT64> recoverDeal(LockJob& job, UINT64 eventId, JournalRecord intent, UINT64 orderTicket) const
     {
-        METHOD_BEGIN();
+        if (!isThreadActive)
+            co_return 0;
+
+        const INT64 time = intent.Time / MILLISECONDS_IN_SEC;
+        std::shared_ptr<WIMTDeal> deal;
 
-        //create deals
-        for (const auto& extendedOrder : extendedOrders)
         {
-            const auto& order = *extendedOrder.Order;
-            WIMTDeal deal(serverApi);
-            deal->Login(order->Login());
-            deal->Symbol(order->Symbol());
-            deal->Action(order->Type());
-            deal->Volume(order->VolumeInitial());
-            deal->Price(order->PriceOrder());
-            deal->Digits(order->Digits());
-            deal->DigitsCurrency(order->DigitsCurrency());
-            deal->ContractSize(order->ContractSize());
-            deal->TimeMsc(order->TimeSetupMsc());
-            deal->RateMargin(order->RateMargin());
-            deal->Order(order->Order());
-            deal->PositionID(order->Order());
-            deal->Entry(IMTDeal::EnDealEntry::ENTRY_OUT);
-            deal->ReasonSet(order->Reason());
-            deal->Comment(L"Open Gap");
-            deal->RateProfit(extendedOrder.RateProfit);
+            //the scope is thread local, so it is opened only between suspensions
+            ALLOC_SCOPE(ALLOCATION_LOCK_DEALS);
 
-            //try to create on server
-            int errors = 0;
-            while (errors <= 10)
+            WIMTDealArray deals(serverApi);
+            if (serverApi->DealGet(intent.Login, time - SECONDS_IN_MINUTE, time + SECONDS_IN_MINUTE, deals) == MT_RET_OK)
             {
-                MTAPIRES retcode = serverApi->DealAdd(deal);
-                if (retcode == MT_RET_ERR_NETWORK || retcode == MT_RET_ERR_FREQUENT || retcode == MT_RET_REQUEST_TOO_MANY || retcode == MT_RET_REQUEST_TIMEOUT)
+                for (UINT i = 0; i < deals->Total(); i++)
                 {
-                    //wait 1 sec and just try again
-                    MAGIC_SLEEP(MILLISECONDS_IN_SEC);
-                    errors++;
-                    continue;
-                }
+                    auto found = deals->Next(i);
+                    if (found->Order() != orderTicket)
+                        continue;
 
-                if (retcode != MT_RET_OK && retcode != MT_RET_OK_NONE)
-                {
-                    LOG_ERROR() << "Problems with creating deals. Status: " << retcode;
-                    errors++;
-                    continue;
+                    LOG_FILE() << "Deal " << found->Deal() << " for order " << orderTicket << " has been found on server";
+                    journal.Append({ .Type = JournalRecord::DEAL_ADDED, .EventId = eventId, .Login = intent.Login, .Position = intent.Position, .Ticket = found->Deal() });
+                    co_return found->Deal();
                 }
+            }
 
-                LOG_FILE() << "Deal " << deal->Deal() << " with position id " << deal->PositionID() << " has been created";
-                break;
+            WIMTOrder order(serverApi);
+            MTAPIRES retcode;
+            if ((retcode = serverApi->HistoryGet(orderTicket, order)) != MT_RET_OK)
+            {
+                LOG_ERROR() << "Cannot get order " << orderTicket << " from server: " << retcode;
+                co_return 0;
             }
 
-            if (errors > 10)
-                LOG_ERROR() << "Can't create lock deal for order and position " << order->Order() << ". Skip.";
+            deal = std::make_shared<WIMTDeal>(serverApi);
+            fillLockDeal(*deal, order, intent.RateProfit);
         }
 
-        METHOD_END();
+        MTAPIRES retcode = co_await submitWithRetries(job, "DealAdd", [&]() { ALLOC_SCOPE(ALLOCATION_LOCK_DEALS); return serverApi->DealAdd(*deal); });
+
+        ALLOC_SCOPE(ALLOCATION_LOCK_DEALS);
+        if (retcode != MT_RET_OK && retcode != MT_RET_OK_NONE)
+        {
+            if (retcode != MT_RET_ERR_CANCEL)
+                stats.Add(&StatsLayout::DealsFailed);
+
+            LOG_ERROR() << "Can't create lock deal for order and position " << orderTicket << ". Skip.";
+            co_return 0;
+        }
+
+        LOG_FILE() << "Deal " << (*deal)->Deal() << " with position id " << (*deal)->PositionID() << " has been created";
+        stats.Add(&StatsLayout::DealsSubmitted);
+        journal.Append({ .Type = JournalRecord::DEAL_ADDED, .EventId = eventId, .Login = intent.Login, .Position = intent.Position, .Ticket = (*deal)->Deal() });
+
+        co_return (*deal)->Deal();
     }
 
-    bool fixPositions(const std::vector<OrderExtended>& extendedOrders) const
+    bool fixPositions(UINT64 eventId, const std::set<UINT64>& logins) const
     {
         METHOD_BEGIN();
+        TRACE_SPAN("fixPositions");
+        ALLOC_SCOPE(ALLOCATION_LOCK_FIX);
 
         WIMTPositionArray positions(serverApi);
 
-        std::set<UINT64> logins;
-        for (const auto& extendedOrder : extendedOrders)
-        {
-            logins.insert((*extendedOrder.Order)->Login());
-        }
-
         for (auto login : logins)
         {
+            if (!isThreadActive)
+                return false;
+
             int errors = 0;
             while (errors <= 10) 
             {
-                MTAPIRES retcode = serverApi->PositionFix(login, positions);
+                MTAPIRES retcode;
+                {
+                    TRACE_SPAN("PositionFix");
+                    retcode = serverApi->PositionFix(login, positions);
+                }
+
                 if (retcode == MT_RET_OK)
                 {
                     LOG_FILE() << "Positions for login " << login << " has been fixed";
+                    stats.Add(&StatsLayout::FixesSubmitted);
+                    journal.Append({ .Type = JournalRecord::POSITIONS_FIXED, .EventId = eventId, .Login = login });
                     break;
                 }
 
+                stats.Add(&StatsLayout::Retries);
                 errors++;
             }
 
             if (errors > 10)
+            {
+                stats.Add(&StatsLayout::FixesFailed);
                 return false;
+            }
         }
 
         return true;
@@ -0,0 +1,130 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include <deque>
+#include <mutex>
+
+// Value replaced by rare writers and read on hot paths without a lock or a reference count.
+// Readers register in the slot of the current epoch for the time they hold the value. A replaced value is freed
+// once the epoch has moved twice past its replacement: each move needs the slot it reuses to be empty, so no reader
+// that could have seen the value is left. Whoever keeps the value longer than a call takes it with Share().
+template <typename T>
+class Published
+{
+public:
+    // Registered reader, holds the value until destroyed
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const Published& published) :
+            readers(published.readers[published.epoch.load(std::memory_order_seq_cst) & 1])
+        {
+            //registered before the load, so a writer which sees the slot empty has already replaced what is loaded here
+            readers.fetch_add(1, std::memory_order_seq_cst);
+            value = published.current.load(std::memory_order_seq_cst);
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        ~ReadGuard()
+        {
+            readers.fetch_sub(1, std::memory_order_release);
+        }
+
+        const T* operator->() const
+        {
+            return value;
+        }
+
+        const T& operator*() const
+        {
+            return *value;
+        }
+
+    private:
+        std::atomic<INT64>& readers;
+        const T* value;
+    };
+
+    explicit Published(std::shared_ptr<T> initial) :
+        owner(std::move(initial)),
+        current(owner.get()),
+        epoch(0)
+    {
+        readers[0] = 0;
+        readers[1] = 0;
+    }
+
+    Published(const Published&) = delete;
+    Published& operator=(const Published&) = delete;
+
+    ReadGuard Read() const
+    {
+        return ReadGuard(*this);
+    }
+
+    std::shared_ptr<T> Share() const
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        return owner;
+    }
+
+    void Store(std::shared_ptr<T> value)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        std::shared_ptr<T> previous = std::move(owner);
+        owner = std::move(value);
+        current.store(owner.get(), std::memory_order_seq_cst);
+
+        retired.push_back({ epoch.load(std::memory_order_seq_cst), std::move(previous) });
+        reclaim();
+    }
+
+    //frees replaced values no reader holds anymore, called periodically so they don't wait for the next Store()
+    void Reclaim()
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        reclaim();
+    }
+
+private:
+    struct Retired
+    {
+        UINT64 Epoch;   //epoch of the replacement
+        std::shared_ptr<T> Value;
+    };
+
+    mutable std::mutex mutex;
+    std::shared_ptr<T> owner;
+    std::atomic<T*> current;
+    std::atomic<UINT64> epoch;
+    mutable std::atomic<INT64> readers[2];  //by epoch parity
+    std::deque<Retired> retired;
+
+    void reclaim()
+    {
+        //the next epoch reuses the slot of the previous one, it moves on only when that slot is empty
+        for (int i = 0; i < 2; i++)
+        {
+            const UINT64 last = epoch.load(std::memory_order_seq_cst);
+            if (readers[(last + 1) & 1].load(std::memory_order_seq_cst) != 0)
+                break;
+
+            epoch.store(last + 1, std::memory_order_seq_cst);
+        }
+
+        const UINT64 last = epoch.load(std::memory_order_seq_cst);
+        while (!retired.empty() && retired.front().Epoch + 2 <= last)
+            retired.pop_front();
+    }
+};
@@ -0,0 +1,143 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include <atomic>
+#include <type_traits>
+
+// Single value slot which keeps only the latest written value.
+// Writers take the slot with a CAS and retry while another write is in progress; a colliding writer keeps
+// whichever of the two values is later, so the fresher one is never lost. Readers retry until they get a consistent copy.
+template <typename T>
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Seqlock value must be trivially copyable");
+
+    enum { WORDS = (sizeof(T) + sizeof(UINT64) - 1) / sizeof(UINT64) };
+
+    // even - stable, odd - write in progress, 0 - never written
+    std::atomic<UINT64> sequence;
+    std::atomic<UINT64> words[WORDS];
+
+public:
+    Seqlock() : sequence(0)
+    {
+        for (auto& word : words)
+        {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    Seqlock(const Seqlock&) = delete;
+    Seqlock& operator=(const Seqlock&) = delete;
+
+    //single writer only: false when another write is in progress, the value is then not stored
+    bool TryWrite(const T& value)
+    {
+        UINT64 seq = sequence.load(std::memory_order_relaxed);
+        if ((seq & 1) != 0 || !sequence.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        //the data stores must not become visible before the odd sequence
+        std::atomic_thread_fence(std::memory_order_release);
+
+        UINT64 buffer[WORDS] = {};
+        memcpy(buffer, &value, sizeof(T));
+
+        for (int i = 0; i < WORDS; i++)
+        {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+
+        sequence.store(seq + 2, std::memory_order_release);
+        return true;
+    }
+
+    //stores the value unless the slot holds a later one by before(value, stored); false when the value is dropped
+    template <typename Before>
+    bool Write(const T& value, Before before)
+    {
+        UINT64 seq = sequence.load(std::memory_order_relaxed);
+        while ((seq & 1) != 0 || !sequence.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            YieldProcessor();
+            seq = sequence.load(std::memory_order_relaxed);
+        }
+
+        //the data stores must not become visible before the odd sequence
+        std::atomic_thread_fence(std::memory_order_release);
+
+        UINT64 buffer[WORDS] = {};
+        if (seq != 0)
+        {
+            for (int i = 0; i < WORDS; i++)
+            {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+
+            T stored;
+            memcpy(&stored, buffer, sizeof(T));
+            if (before(value, stored))
+            {
+                //nothing changed, readers which started before keep a consistent copy
+                sequence.store(seq, std::memory_order_release);
+                return false;
+            }
+        }
+
+        memcpy(buffer, &value, sizeof(T));
+        for (int i = 0; i < WORDS; i++)
+        {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+
+        sequence.store(seq + 2, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> Read() const
+    {
+        while (true)
+        {
+            UINT64 before = sequence.load(std::memory_order_acquire);
+            if (before == 0)
+            {
+                return std::nullopt;
+            }
+
+            if ((before & 1) != 0)
+            {
+                YieldProcessor();
+                continue;
+            }
+
+            UINT64 buffer[WORDS];
+            for (int i = 0; i < WORDS; i++)
+            {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+            {
+                T value;
+                memcpy(&value, buffer, sizeof(T));
+                return value;
+            }
+        }
+    }
+
+    bool HasValue() const
+    {
+        return sequence.load(std::memory_order_acquire) != 0;
+    }
+};
@@ -72,15 +72,74 @@ public:
                 continue;
             }
 
+            if (name == "TraceDir")
+            {
+                pluginSettings.TraceDir = pluginbase::tools::WideToString(param->Value());
+                boost::trim(pluginSettings.TraceDir);
+                continue;
+            }
+
+            if (name == "GapEventDir")
+            {
+                pluginSettings.GapEventDir = pluginbase::tools::WideToString(param->Value());
+                boost::trim(pluginSettings.GapEventDir);
+                continue;
+            }
+
+            if (name == "JournalPath")
+            {
+                pluginSettings.JournalPath = pluginbase::tools::WideToString(param->Value());
+                boost::trim(pluginSettings.JournalPath);
+                continue;
+            }
+
+            if (name == "PartitionLeaseFile" || name == "PartitionMember")
+            {
+                auto& field = name == "PartitionLeaseFile" ? pluginSettings.PartitionLeaseFile : pluginSettings.PartitionMember;
+                field = pluginbase::tools::WideToString(param->Value());
+                boost::trim(field);
+                continue;
+            }
+
+            if (name == "LockThreads" || name == "BackgroundThreads")
+            {
+                auto& threads = name == "LockThreads" ? pluginSettings.LockThreads : pluginSettings.BackgroundThreads;
+                threads = static_cast<UINT>(parseNumberField(name, pluginbase::tools::WideToString(param->Value())));
+                continue;
+            }
+
+            if (name == "LockAffinity" || name == "BackgroundAffinity" || name == "ServiceAffinity")
+            {
+                auto& affinity = name == "LockAffinity" ? pluginSettings.LockAffinity
+                    : name == "BackgroundAffinity" ? pluginSettings.BackgroundAffinity : pluginSettings.ServiceAffinity;
+                affinity = parseNumberField(name, pluginbase::tools::WideToString(param->Value()));
+                continue;
+            }
+
+            if (name == "AllocationTracking")
+            {
+                pluginSettings.AllocationTracking = parseBoolField(pluginbase::tools::WideToString(param->Value()));
+                continue;
+            }
+
             if (name == "DebugLogs")
             {
                 pluginSettings.DebugLogs = parseBoolField(pluginbase::tools::WideToString(param->Value()));
                 continue;
             }
 
+            if (boost::starts_with(name, "Rule"))
+            {
+                parseAndCreateRule(pluginSettings, pluginbase::tools::WideToString(param->Value()), name);
+                continue;
+            }
+
             parseAndCreateSymbol(pluginSettings, param, name);
         }
 
+        compileRules(serverApi, pluginSettings);
+        applyPartitionMember(pluginSettings, pluginbase::tools::WideToString(plugin->Name()));
+
         // Update plugin config
         retcode = serverApi->PluginAdd(plugin);
         if (retcode != MT_RET_OK && retcode != MT_RET_OK_NONE)
@@ -108,7 +167,17 @@ public:
 
         LOG_FILE() << "[PluginSettings] Status: " << pluginSettings.Status
             << "; DebugLogs: " << pluginSettings.DebugLogs
-            << "; Groups: " << pluginSettings.Groups;
+            << "; Groups: " << pluginSettings.Groups
+            << "; TraceDir: " << pluginSettings.TraceDir
+            << "; AllocationTracking: " << pluginSettings.AllocationTracking
+            << "; GapEventDir: " << pluginSettings.GapEventDir
+            << "; JournalPath: " << pluginSettings.JournalPath
+            << "; PartitionLeaseFile: " << pluginSettings.PartitionLeaseFile
+            << "; PartitionMember: " << pluginSettings.PartitionMember
+            << "; LockThreads: " << pluginSettings.LockThreads << " (affinity 0x" << std::hex << pluginSettings.LockAffinity << std::dec << ")"
+            << "; BackgroundThreads: " << pluginSettings.BackgroundThreads << " (affinity 0x" << std::hex << pluginSettings.BackgroundAffinity << std::dec << ")"
+            << "; ServiceAffinity: 0x" << std::hex << pluginSettings.ServiceAffinity << std::dec
+            << "; Rules: " << pluginSettings.Rules.size();
 
         METHOD_END();
     }
@@ -130,6 +199,7 @@ private:
 
             auto symbol = std::make_shared<Symbol>();
             symbol->Name = name;
+            symbol->WideName = param->Name();
             symbol->BeginTimeOffset = std::stoi(matchResults[1].str()) * SECONDS_IN_HOUR + std::stoi(matchResults[2].str()) * SECONDS_IN_MINUTE;
             symbol->EndTimeOffset = std::stoi(matchResults[3].str()) * SECONDS_IN_HOUR + std::stoi(matchResults[4].str())* SECONDS_IN_MINUTE;
 
@@ -150,9 +220,132 @@ private:
         }
     }
 
-    static bool parseBoolField(std::string field)
+    // Rule value format: <group mask>;<symbol mask>;<BUY|SELL|ANY>;<points>;<enabled>
+    static void parseAndCreateRule(PluginSettings& pluginSettings, const std::string& value, const std::string& name)
+    {
+        try
+        {
+            std::vector<std::string> arr;
+            boost::split(arr, value, [&](char c) { return c == ';'; });
+            if (arr.size() != 5)
+            {
+                LOG_FILE() << "Cannot parse '" << name << "' rule value [" << value << "]. Skip";
+                return;
+            }
+
+            for (auto& field : arr)
+                boost::trim(field);
+
+            LockRuleSource rule;
+            rule.GroupMask = arr[0];
+            rule.SymbolMask = arr[1];
+
+            std::string side = boost::to_upper_copy(arr[2]);
+            if (side == "BUY")
+            {
+                rule.PositionAction = IMTPosition::EnPositionAction::POSITION_BUY;
+            }
+            else if (side == "SELL")
+            {
+                rule.PositionAction = IMTPosition::EnPositionAction::POSITION_SELL;
+            }
+            else if (side != "ANY")
+            {
+                LOG_FILE() << "Cannot parse '" << name << "' rule side [" << arr[2] << "]. Skip";
+                return;
+            }
+
+            rule.Points = std::stoi(arr[3]);
+
+            //a rule whose flag can't be read is not guessed into either state
+            auto enabled = tryParseBoolField(arr[4]);
+            if (!enabled.has_value())
+            {
+                LOG_ERROR() << "Cannot parse '" << name << "' rule enabled flag [" << arr[4] << "]. Skip";
+                return;
+            }
+
+            rule.Enabled = *enabled;
+
+            pluginSettings.Rules.push_back(rule);
+
+            LOG_FILE() << "Added new rule '" << name << "' with Groups = " << rule.GroupMask << ", Symbols = " << rule.SymbolMask
+                << ", Side = " << side << ", Points = " << rule.Points << " and Enabled = " << rule.Enabled;
+        }
+        catch (const std::exception & ex)
+        {
+            LOG_FILE() << ex.what();
+        }
+    }
+
+    //instances sharing a lease file usually share the config too, while the journal and the gap event files are
+    //opened by one instance only, so each member gets its own: journal.bin becomes journal.<member>.bin and
+    //the gap events go to a <member> subdirectory
+    static void applyPartitionMember(PluginSettings& pluginSettings, const std::string& pluginName)
+    {
+        METHOD_BEGIN();
+
+        if (pluginSettings.PartitionLeaseFile.empty())
+            return;
+
+        //the member name defaults to the plugin config name, so it stays the same across restarts
+        if (pluginSettings.PartitionMember.empty())
+            pluginSettings.PartitionMember = pluginName;
+
+        if (!pluginSettings.JournalPath.empty())
+        {
+            boost::filesystem::path path(pluginSettings.JournalPath);
+            path.replace_extension("." + pluginSettings.PartitionMember + path.extension().string());
+            pluginSettings.JournalPath = path.string();
+        }
+
+        if (!pluginSettings.GapEventDir.empty())
+            pluginSettings.GapEventDir = (boost::filesystem::path(pluginSettings.GapEventDir) / pluginSettings.PartitionMember).string();
+
+        METHOD_END();
+    }
+
+    static void compileRules(IMTServerAPI* serverApi, PluginSettings& pluginSettings)
     {
         METHOD_BEGIN();
+
+        auto& symbols = pluginSettings.SymbolsById;
+        symbols.clear();
+        for (auto& [name, symbol] : pluginSettings.Symbols)
+        {
+            symbol->Id = symbols.size();
+            symbols.push_back(symbol);
+        }
+
+        pluginSettings.RuleTable = LockRuleTable::Compile(serverApi, pluginSettings.Groups, symbols, pluginSettings.Rules);
+
+        METHOD_END();
+    }
+
+    //decimal or 0x-prefixed hex, 0 if malformed
+    static UINT64 parseNumberField(const std::string& name, std::string field)
+    {
+        boost::trim(field);
+        if (field.empty())
+            return 0;
+
+        try
+        {
+            size_t parsed = 0;
+            UINT64 value = std::stoull(field, &parsed, 0);
+            if (parsed == field.size())
+                return value;
+        }
+        catch (...)
+        {
+        }
+
+        LOG_FILE() << "Cannot parse '" << name << "' value [" << field << "]. Using 0";
+        return 0;
+    }
+
+    static std::optional<bool> tryParseBoolField(std::string field)
+    {
         boost::to_lower(field);
         boost::trim(field);
 
@@ -166,7 +359,19 @@ private:
             return false;
         }
 
-        LOG_ERROR() << "Can't decide whether '" << field << "' should disable the rule. Assuming `enabled`.";
+        return std::nullopt;
+    }
+
+    static bool parseBoolField(std::string field)
+    {
+        METHOD_BEGIN();
+
+        if (auto value = tryParseBoolField(field))
+        {
+            return *value;
+        }
+
+        LOG_ERROR() << "Cannot parse boolean value [" << field << "]. Assuming `false`.";
         return false;
         METHOD_END();
     }
@@ -0,0 +1,128 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include "Models/StatsLayout.h"
+
+// Publishes plugin counters in a named shared-memory segment, external monitors read it without any locking.
+// Until the segment is opened (or if it cannot be created) counters go into a private copy.
+// Open must be called before any other thread touches the counters.
+class StatsSegment
+{
+public:
+    StatsSegment() :
+        mapping(NULL),
+        layout(&local)
+    {
+        initialize(local);
+    }
+
+    ~StatsSegment()
+    {
+        if (mapping != NULL)
+        {
+            UnmapViewOfFile(layout);
+            CloseHandle(mapping);
+        }
+    }
+
+    StatsSegment(const StatsSegment&) = delete;
+    StatsSegment& operator=(const StatsSegment&) = delete;
+
+    bool Open(const std::wstring& name)
+    {
+        METHOD_BEGIN();
+
+        if (mapping != NULL)
+            return true;
+
+        std::wstring segmentName = STATS_SEGMENT_PREFIX + name;
+
+        mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(StatsLayout), segmentName.c_str());
+        if (mapping == NULL)
+        {
+            LOG_ERROR() << "Cannot create stats segment " << pluginbase::tools::WideToString(segmentName) << ", error = " << GetLastError();
+            return false;
+        }
+
+        auto shared = static_cast<StatsLayout*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(StatsLayout)));
+        if (shared == nullptr)
+        {
+            LOG_ERROR() << "Cannot map stats segment " << pluginbase::tools::WideToString(segmentName) << ", error = " << GetLastError();
+            CloseHandle(mapping);
+            mapping = NULL;
+            return false;
+        }
+
+        //the segment starts from the values collected so far
+        initialize(*shared);
+        copy(local, *shared);
+        layout = shared;
+
+        LOG_FILE() << "Stats are published in " << pluginbase::tools::WideToString(segmentName);
+        return true;
+
+        METHOD_END();
+    }
+
+    void Add(std::atomic<UINT64> StatsLayout::* counter, UINT64 value = 1) const
+    {
+        (layout->*counter).fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void Add(std::atomic<INT64> StatsLayout::* gauge, INT64 value) const
+    {
+        (layout->*gauge).fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void Set(std::atomic<INT64> StatsLayout::* gauge, INT64 value) const
+    {
+        (layout->*gauge).store(value, std::memory_order_relaxed);
+    }
+
+    void Max(std::atomic<INT64> StatsLayout::* gauge, INT64 value) const
+    {
+        auto& target = layout->*gauge;
+        INT64 current = target.load(std::memory_order_relaxed);
+        while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    }
+
+    void Set(std::atomic<UINT64> (StatsLayout::* counters)[ALLOCATION_SCOPE_TOTAL], size_t index, UINT64 value) const
+    {
+        (layout->*counters)[index].store(value, std::memory_order_relaxed);
+    }
+
+private:
+    HANDLE mapping;
+    StatsLayout* layout;
+    StatsLayout local;
+
+    static void initialize(StatsLayout& target)
+    {
+        memset(&target, 0, sizeof(target));
+
+        target.Magic = StatsLayout::MAGIC;
+        target.Version = StatsLayout::VERSION;
+        target.Size = sizeof(StatsLayout);
+        target.ProcessId = GetCurrentProcessId();
+        target.StartTime = _time64(nullptr);
+    }
+
+    static void copy(const StatsLayout& from, StatsLayout& to)
+    {
+        //header is left as is, all fields after it are 8-byte atomics
+        constexpr size_t offset = offsetof(StatsLayout, StartTime);
+        auto source = reinterpret_cast<const std::atomic<UINT64>*>(reinterpret_cast<const char*>(&from) + offset);
+        auto target = reinterpret_cast<std::atomic<UINT64>*>(reinterpret_cast<char*>(&to) + offset);
+
+        for (size_t i = 0; i < (sizeof(StatsLayout) - offset) / sizeof(UINT64); i++)
+            target[i].store(source[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+};
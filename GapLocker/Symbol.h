@@ -1,23 +1,65 @@
 #pragma once
 #include "stdafx.h"
+#include "Seqlock.h"
+#include "Coroutines.h"
+
+// Tick and lock state of a symbol. Settings reload recreates the Symbol but shares its state, so the old
+// and the new snapshot see one session marker and a session is opened only once.
+struct SymbolState
+{
+    //conflated tick state, written from OnTick without locking
+    std::atomic<time_t> SessionStart;   //start of the current session, 0 - no session yet
+    Seqlock<MTTickShort> SessionEndInfo;
+
+    //lock events of the symbol run one at a time on the strand
+    Strand LockStrand;
+    std::atomic<size_t> LastLockPositions;  //size estimate for the next event
+
+    //GetTickCount64 deadline of the partition lease, 0 - another instance of the partition locks the symbol
+    std::atomic<UINT64> OwnedUntil;
+
+    SymbolState() :
+        SessionStart(0),
+        LastLockPositions(0),
+        OwnedUntil(UINT64_MAX){}
+
+    //the lease is checked here as well, a service thread which misses its renewals doesn't keep the symbol owned
+    bool Owned() const
+    {
+        return GetTickCount64() < OwnedUntil.load(std::memory_order_acquire);
+    }
+};
+
+//ticks of one symbol are ordered by their server time
+inline bool TickBefore(const MTTickShort& tick, const MTTickShort& other)
+{
+    return tick.datetime_msc < other.datetime_msc;
+}
 
 struct Symbol
 {
     std::string Name;
+    std::wstring WideName;  //as the server reports it, no conversion on API calls
+    size_t Id;      //index in the rule table
     int Points;
     time_t BeginTimeOffset;
     time_t EndTimeOffset;
 
-    std::optional<MTTickShort> SessionStartInfo;
-    std::optional<MTTickShort> SessionEndInfo;
+    std::shared_ptr<SymbolState> State;
 
     Symbol() : 
         Name(""), 
+        Id(0), 
         Points(0), 
         BeginTimeOffset(0), 
         EndTimeOffset(SECONDS_IN_DAY), 
-        SessionStartInfo(std::nullopt), 
-        SessionEndInfo(std::nullopt){}
+        State(std::make_shared<SymbolState>()){}
+
+    //the symbol recreated by settings reload takes over the state of the one it replaces
+    void ShareState(const Symbol& other)
+    {
+        State = other.State;
+    }
 
     time_t GetStartTimeWithOffset(time_t current) 
     {
@@ -40,4 +82,19 @@ struct Symbol
 
         return mktime(t) + EndTimeOffset;
     }
+
+    //session around the time, returns whether the time is inside it
+    bool GetSession(time_t time, time_t& sessionStart, time_t& sessionEnd)
+    {
+        sessionStart = GetStartTimeWithOffset(time);
+        sessionEnd = GetEndTimeWithOffset(sessionStart);
+
+        if (sessionStart > time)
+        {
+            sessionStart -= SECONDS_IN_DAY;
+            sessionEnd -= SECONDS_IN_DAY;
+        }
+
+        return sessionStart <= time && sessionEnd > time;
+    }
 };
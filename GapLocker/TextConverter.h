@@ -0,0 +1,109 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include <string_view>
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(wchar_t) == sizeof(UINT16), "Wide strings are expected to be UTF-16");
+
+// Conversion target which keeps short strings inline, longer ones go to the heap
+template <typename Char, size_t N>
+class TextBuffer
+{
+public:
+    Char* Reserve(size_t length)
+    {
+        if (length < N)
+            return inlineData;
+
+        heapData.resize(length);
+        return heapData.data();
+    }
+
+    std::basic_string_view<Char> Assign(std::basic_string<Char>&& value)
+    {
+        heapData = std::move(value);
+        return heapData;
+    }
+
+private:
+    Char inlineData[N];
+    std::basic_string<Char> heapData;
+};
+
+typedef TextBuffer<char, 64> NarrowBuffer;
+
+// UTF-16 -> UTF-8 conversion of symbol names on the tick path, wide names for the server API are cached in Symbol.
+// Names are almost always ASCII, so they are checked and converted 8 (16 with AVX2) characters at a time,
+// the full conversion is done only for the rest.
+class TextConverter
+{
+public:
+    static std::string_view ToNarrow(LPCWSTR source, NarrowBuffer& buffer)
+    {
+        size_t length = wcslen(source);
+        char* target = buffer.Reserve(length + 1);
+
+        if (!narrowAscii(source, length, target))
+            return buffer.Assign(pluginbase::tools::WideToString(source));
+
+        target[length] = 0;
+        return std::string_view(target, length);
+    }
+
+    static bool Equals(LPCWSTR value, std::wstring_view expected)
+    {
+        return wcsncmp(value, expected.data(), expected.size()) == 0 && value[expected.size()] == 0;
+    }
+
+private:
+    static bool narrowAscii(const wchar_t* source, size_t length, char* target)
+    {
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        const __m256i nonAscii256 = _mm256_set1_epi16(static_cast<short>(0xFF80));
+        for (; i + 16 <= length; i += 16)
+        {
+            __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+            if (!_mm256_testz_si256(chars, nonAscii256))
+                return false;
+
+            __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(chars), _mm256_extracti128_si256(chars, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i), packed);
+        }
+#endif
+
+        const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= length; i += 8)
+        {
+            __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chars, nonAscii), zero)) != 0xFFFF)
+                return false;
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(target + i), _mm_packus_epi16(chars, chars));
+        }
+
+        for (; i < length; i++)
+        {
+            if (source[i] > 0x7F)
+                return false;
+
+            target[i] = static_cast<char>(source[i]);
+        }
+
+        return true;
+    }
+};
@@ -0,0 +1,259 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include "Seqlock.h"
+#include <fstream>
+#include <mutex>
+#include <boost/preprocessor/cat.hpp>
+
+struct TraceRecord
+{
+    const char* Name;   //string literal
+    INT64 Begin;        //microseconds
+    INT64 Duration;     //microseconds
+    UINT64 AsyncId;     //0 - span of the thread, else span of a coroutine which may move between threads
+};
+
+// Ring of the latest spans of one thread, written by the owner thread only
+class TraceBuffer
+{
+public:
+    enum { CAPACITY = 4096 };
+
+    const DWORD ThreadId;
+
+    TraceBuffer() : ThreadId(GetCurrentThreadId()), Exited(false), head(0), flushed(0) {}
+
+    //set by the owner thread on exit, the buffer is dropped after its last drain
+    std::atomic<bool> Exited;
+
+    void Push(const TraceRecord& record)
+    {
+        UINT64 position = head.load(std::memory_order_relaxed);
+        records[position % CAPACITY].TryWrite(record);
+        head.store(position + 1, std::memory_order_release);
+    }
+
+    //spans recorded since the previous drain, the oldest are lost if the ring has wrapped
+    template <typename Handler>
+    void Drain(Handler handler)
+    {
+        UINT64 last = head.load(std::memory_order_acquire);
+        UINT64 first = last > CAPACITY && last - CAPACITY > flushed ? last - CAPACITY : flushed;
+
+        for (UINT64 position = first; position < last; position++)
+        {
+            if (auto record = records[position % CAPACITY].Read())
+                handler(*record);
+        }
+
+        flushed = last;
+    }
+
+private:
+    std::atomic<UINT64> head;
+    UINT64 flushed;     //guarded by the tracer mutex
+    Seqlock<TraceRecord> records[CAPACITY];
+};
+
+// Span tracing exported in Chrome/Perfetto trace format.
+// Spans go into per-thread rings and are written to a new json file on each flush. A flush takes the spans of all
+// threads collected since the previous one, so events which run at the same time share a file.
+class Tracer
+{
+public:
+    static Tracer& Instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    //empty directory disables tracing
+    void Configure(const std::string& traceDirectory)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        directory = traceDirectory;
+        enabled.store(!directory.empty(), std::memory_order_relaxed);
+    }
+
+    bool IsEnabled() const
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    void Record(const char* name, INT64 begin, INT64 end, UINT64 asyncId = 0)
+    {
+        localBuffer().Push({ name, begin, end - begin, asyncId });
+    }
+
+    //spans with the same ID are shown nested on one track
+    static UINT64 NextAsyncId()
+    {
+        static std::atomic<UINT64> next = 1;
+        return next++;
+    }
+
+    bool Flush()
+    {
+        METHOD_BEGIN();
+
+        std::lock_guard<std::mutex> guard(mutex);
+
+        //disabled: nothing is written, rings of exited threads are dropped with their spans
+        if (directory.empty())
+        {
+            std::erase_if(buffers, [](const std::shared_ptr<TraceBuffer>& buffer) { return buffer->Exited.load(std::memory_order_acquire); });
+            return false;
+        }
+
+        boost::filesystem::create_directories(directory);
+
+        auto now = boost::posix_time::microsec_clock::universal_time();
+        auto path = boost::filesystem::path(directory) / ("GapLocker-" + boost::posix_time::to_iso_string(now) + ".json");
+
+        std::ofstream file(path.string(), std::ios::out | std::ios::trunc);
+        if (!file)
+        {
+            LOG_ERROR() << "Cannot create trace file " << path.string();
+            return false;
+        }
+
+        const DWORD processId = GetCurrentProcessId();
+        size_t spans = 0;
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        size_t exited = 0;
+        for (auto& buffer : buffers)
+        {
+            //read before the drain, so spans pushed before the exit are written before the ring is dropped
+            const bool last = buffer->Exited.load(std::memory_order_acquire);
+
+            file << (spans++ ? "," : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << processId << ",\"tid\":" << buffer->ThreadId
+                << ",\"args\":{\"name\":\"GapLocker " << buffer->ThreadId << "\"}}";
+
+            buffer->Drain([&](const TraceRecord& record) {
+                if (record.AsyncId == 0)
+                {
+                    file << ",{\"name\":\"" << record.Name << "\",\"cat\":\"gaplocker\",\"ph\":\"X\",\"ts\":" << record.Begin
+                        << ",\"dur\":" << record.Duration << ",\"pid\":" << processId << ",\"tid\":" << buffer->ThreadId << "}";
+                }
+                else
+                {
+                    //a coroutine span begins and ends on different threads, so it is a pair of async events
+                    file << ",{\"name\":\"" << record.Name << "\",\"cat\":\"gaplocker\",\"ph\":\"b\",\"id\":" << record.AsyncId << ",\"ts\":" << record.Begin
+                        << ",\"pid\":" << processId << ",\"tid\":" << buffer->ThreadId << "}"
+                        << ",{\"name\":\"" << record.Name << "\",\"cat\":\"gaplocker\",\"ph\":\"e\",\"id\":" << record.AsyncId << ",\"ts\":" << record.Begin + record.Duration
+                        << ",\"pid\":" << processId << ",\"tid\":" << buffer->ThreadId << "}";
+                }
+
+                spans++;
+                });
+
+            if (last)
+            {
+                buffer.reset();
+                exited++;
+            }
+        }
+        file << "]}";
+
+        LOG_FILE() << "Trace with " << spans - buffers.size() << " spans has been written to " << path.string();
+
+        //rings of exited threads have nothing more to give
+        if (exited > 0)
+            std::erase(buffers, nullptr);
+
+        return true;
+
+        METHOD_END();
+    }
+
+    static INT64 Now()
+    {
+        static const INT64 frequency = []() { LARGE_INTEGER value; QueryPerformanceFrequency(&value); return value.QuadPart; }();
+
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+
+        return counter.QuadPart / frequency * 1000000 + counter.QuadPart % frequency * 1000000 / frequency;
+    }
+
+private:
+    std::mutex mutex;
+    std::string directory;
+    std::atomic<bool> enabled = false;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;     //buffers of exited threads are kept until their spans are flushed
+
+    // Buffer of the calling thread, marked on thread exit so pool restarts don't leave their rings behind
+    class LocalBuffer
+    {
+    public:
+        ~LocalBuffer()
+        {
+            if (buffer)
+                buffer->Exited.store(true, std::memory_order_release);
+        }
+
+        std::shared_ptr<TraceBuffer> buffer;
+    };
+
+    TraceBuffer& localBuffer()
+    {
+        thread_local LocalBuffer local;
+
+        if (!local.buffer)
+        {
+            local.buffer = std::make_shared<TraceBuffer>();
+
+            std::lock_guard<std::mutex> guard(mutex);
+            buffers.push_back(local.buffer);
+        }
+
+        return *local.buffer;
+    }
+};
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name, UINT64 asyncId = 0) :
+        name(name),
+        asyncId(asyncId),
+        begin(Tracer::Instance().IsEnabled() ? Tracer::Now() : 0){}
+
+    ~TraceSpan()
+    {
+        End();
+    }
+
+    void End()
+    {
+        if (begin != 0)
+        {
+            Tracer::Instance().Record(name, begin, Tracer::Now(), asyncId);
+            begin = 0;
+        }
+    }
+
+private:
+    const char* name;
+    const UINT64 asyncId;
+    INT64 begin;
+};
+
+#define TRACE_SPAN(name) TraceSpan BOOST_PP_CAT(traceSpan, __LINE__)(name)
+
+// span of a coroutine body which lives across co_await, the ID ties it to the other spans of the coroutine
+#define TRACE_ASYNC_SPAN(name, asyncId) TraceSpan BOOST_PP_CAT(traceSpan, __LINE__)(name, asyncId)
+
+// LOCK() split into acquire and hold spans
+#define TRACE_LOCK() TraceSpan traceLockAcquire("LOCK.acquire"); LOCK(); traceLockAcquire.End(); TraceSpan traceLockHold("LOCK.hold")
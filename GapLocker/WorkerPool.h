@@ -0,0 +1,146 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//|
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+#pragma once
+
+#include "stdafx.h"
+#include <bit>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Fixed set of worker threads, optionally pinned to a set of cores.
+// Stop runs the jobs already queued before the threads exit.
+class WorkerPool
+{
+public:
+    typedef std::function<void()> Job;
+
+    explicit WorkerPool(const std::wstring& name) :
+        name(name),
+        stopping(false){}
+
+    ~WorkerPool()
+    {
+        Stop();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    //0 threads - one per core of the affinity mask, 0 mask - any core
+    void Start(size_t threadCount, UINT64 affinity)
+    {
+        METHOD_BEGIN();
+
+        if (!threads.empty())
+            return;
+
+        if (threadCount == 0)
+            threadCount = affinity != 0 ? std::popcount(affinity) : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            stopping = false;
+        }
+
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            threads.emplace_back([this, affinity, i]() { run(affinity, i); });
+        }
+
+        LOG_FILE() << "Pool '" << pluginbase::tools::WideToString(name) << "' started with " << threadCount << " threads, affinity mask 0x" << std::hex << affinity << std::dec;
+
+        METHOD_END();
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            stopping = true;
+        }
+
+        wakeup.notify_all();
+
+        for (auto& thread : threads)
+            thread.join();
+
+        threads.clear();
+    }
+
+    //false when the pool is stopped, the job is dropped
+    bool Push(Job job)
+    {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (stopping)
+                return false;
+
+            jobs.push_back(std::move(job));
+        }
+
+        wakeup.notify_one();
+        return true;
+    }
+
+    //pins the calling thread, 0 mask - any core
+    static void Pin(UINT64 affinity)
+    {
+        if (affinity != 0 && SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(affinity)) == 0)
+            LOG_ERROR() << "Cannot set thread affinity mask 0x" << std::hex << affinity << std::dec << ", error = " << GetLastError();
+    }
+
+    //names the calling thread for debuggers, SetThreadDescription is looked up since older hosts don't have it
+    static void Describe(const std::wstring& description)
+    {
+        typedef HRESULT(WINAPI* SetThreadDescriptionFunction)(HANDLE, PCWSTR);
+        static const auto setThreadDescription = reinterpret_cast<SetThreadDescriptionFunction>(
+            GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription"));
+
+        if (setThreadDescription != nullptr)
+            setThreadDescription(GetCurrentThread(), description.c_str());
+    }
+
+private:
+    const std::wstring name;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<Job> jobs;
+    bool stopping;
+
+    void run(UINT64 affinity, size_t index)
+    {
+        Pin(affinity);
+        Describe(name + L" " + std::to_wstring(index));
+
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+                if (jobs.empty())
+                    return;
+
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            execute(job);
+        }
+    }
+
+    static void execute(const Job& job)
+    {
+        SAFE_BEGIN_NAME(WorkerPool_job) job(); SAFE_END();
+    }
+};
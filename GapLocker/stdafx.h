@@ -30,6 +30,7 @@
 #include <sstream>
 #include <memory>
 #include <optional>
+#include <atomic>
 
 #include "Const.h"
 
@@ -0,0 +1,493 @@
+//| Take --------      MT5 & MT4 plugins, applications, and services
+//| profit ------      for medium-sized brokers.
+//| techno ------
+//| logy --------      www.takeprofit.technology
+//| 
+//| This product was developed by Takeprofit Technology.
+//| All rights reserved. Distribution and use of this file is prohibited unless explicitly granted by written agreement.
+
+// GapLockerCli : reads what GapLocker publishes without touching the plugin or the trade server
+
+#include <windows.h>
+#include <cstdio>
+#include <cstddef>
+#include <climits>
+#include <cmath>
+#include <ctime>
+#include <cwctype>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../GapLocker/Models/StatsLayout.h"
+#include "../GapLocker/Models/GapEventLayout.h"
+
+struct StatsField
+{
+    const char* Name;
+    size_t Offset;
+    bool Gauge;
+};
+
+#define STATS_COUNTER(name) { #name, offsetof(StatsLayout, name), false }
+#define STATS_GAUGE(name) { #name, offsetof(StatsLayout, name), true }
+
+static const StatsField statsFields[] =
+{
+    STATS_COUNTER(TicksSeen),
+    STATS_COUNTER(TicksMatched),
+    STATS_COUNTER(SessionsOpened),
+    STATS_COUNTER(GapsDetected),
+    STATS_COUNTER(LockEvents),
+    STATS_COUNTER(OrdersSubmitted),
+    STATS_COUNTER(OrdersFailed),
+    STATS_COUNTER(DealsSubmitted),
+    STATS_COUNTER(DealsFailed),
+    STATS_COUNTER(FixesSubmitted),
+    STATS_COUNTER(FixesFailed),
+    STATS_COUNTER(Retries),
+    STATS_GAUGE(QueueDepth),
+    STATS_GAUGE(LocksInProgress),
+    STATS_COUNTER(RequestsQueued),
+    STATS_COUNTER(RequestsDropped),
+    STATS_COUNTER(QueueLatencyTotal),
+    STATS_GAUGE(QueueLatencyMax),
+    STATS_GAUGE(ReadyDepth),
+};
+
+static const char* allocationScopes[ALLOCATION_SCOPE_TOTAL] =
+{
+    "Other",
+    "OnTick",
+    "SettingsReload",
+    "LockPositions",
+    "LockOrders",
+    "LockDeals",
+    "LockFix",
+};
+
+static void printAllocations(const StatsLayout* layout)
+{
+    if (offsetof(StatsLayout, AllocationBytes) + sizeof(layout->AllocationBytes) > layout->Size)
+        return;
+
+    printf("  %-20s %12s %14s %16s %12s\n", "Allocations", "entries", "count", "bytes", "per entry");
+    for (size_t scope = 0; scope < ALLOCATION_SCOPE_TOTAL; scope++)
+    {
+        UINT64 entries = layout->AllocationEntries[scope].load(std::memory_order_relaxed);
+        UINT64 count = layout->AllocationCount[scope].load(std::memory_order_relaxed);
+        UINT64 bytes = layout->AllocationBytes[scope].load(std::memory_order_relaxed);
+
+        printf("  %-20s %12llu %14llu %16llu %12.1f\n", allocationScopes[scope], entries, count, bytes, entries ? double(count) / entries : 0.0);
+    }
+}
+
+static int usage()
+{
+    printf("Usage:\n");
+    printf("  GapLockerCli stats [plugin config name] [--watch seconds]\n");
+    printf("  GapLockerCli gaps <gap event directory> [--member name] [--symbol mask] [--from YYYY.MM.DD] [--to YYYY.MM.DD] [--list]\n");
+    return 1;
+}
+
+static int printStats(const std::wstring& name, int watchSeconds)
+{
+    std::wstring segmentName = STATS_SEGMENT_PREFIX + name;
+
+    HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, segmentName.c_str());
+    if (mapping == NULL)
+    {
+        fwprintf(stderr, L"Cannot open stats segment %s, error = %lu\n", segmentName.c_str(), GetLastError());
+        return 2;
+    }
+
+    auto layout = static_cast<const StatsLayout*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (layout == nullptr || layout->Magic != StatsLayout::MAGIC)
+    {
+        fwprintf(stderr, L"Segment %s is not a GapLocker stats segment\n", segmentName.c_str());
+        return 2;
+    }
+
+    //segments of newer plugins have more fields, older ones fewer
+    while (true)
+    {
+        time_t started = layout->StartTime.load();
+        char startedText[32] = {};
+        strftime(startedText, sizeof(startedText), "%Y.%m.%d %H:%M:%S", gmtime(&started));
+
+        printf("GapLocker stats v%u, process %u, started %s UTC\n", layout->Version, layout->ProcessId, startedText);
+
+        for (const auto& field : statsFields)
+        {
+            if (field.Offset + sizeof(UINT64) > layout->Size)
+                continue;
+
+            auto value = reinterpret_cast<const std::atomic<INT64>*>(reinterpret_cast<const char*>(layout) + field.Offset)->load(std::memory_order_relaxed);
+            if (field.Gauge)
+                printf("  %-20s %lld\n", field.Name, value);
+            else
+                printf("  %-20s %llu\n", field.Name, static_cast<UINT64>(value));
+        }
+
+        if (offsetof(StatsLayout, QueueLatencyTotal) + sizeof(UINT64) <= layout->Size)
+        {
+            UINT64 queued = layout->RequestsQueued.load(std::memory_order_relaxed);
+            printf("  %-20s %.1f us\n", "QueueLatencyAvg", queued ? double(layout->QueueLatencyTotal.load(std::memory_order_relaxed)) / queued : 0.0);
+        }
+
+        printAllocations(layout);
+
+        if (watchSeconds <= 0)
+            break;
+
+        Sleep(watchSeconds * 1000);
+        printf("\n");
+    }
+
+    UnmapViewOfFile(layout);
+    CloseHandle(mapping);
+    return 0;
+}
+
+struct GapQuery
+{
+    std::wstring Directory;
+    std::wstring SymbolMask = L"*";
+    std::wstring Member;        //partition member, empty - the directory and all members
+    INT64 From = 0;             //unix time, inclusive
+    INT64 To = LLONG_MAX;       //unix time, exclusive
+    bool List = false;
+};
+
+struct GapAggregate
+{
+    UINT64 Events = 0;
+    UINT64 Locked = 0;
+    UINT64 Positions = 0;
+    UINT64 Orders = 0;
+    UINT64 Deals = 0;
+    double PointsSum = 0;
+    double PointsMax = 0;
+    std::vector<INT64> Latencies;
+
+    void Add(const GapEventRecord& record, double points)
+    {
+        Events++;
+        Locked += record.Fixed;
+        Positions += record.Positions;
+        Orders += record.Orders;
+        Deals += record.Deals;
+        PointsSum += points;
+        PointsMax = std::max(PointsMax, points);
+        Latencies.push_back(record.LatencyMicroseconds);
+    }
+};
+
+static bool matchMask(const wchar_t* value, const wchar_t* mask)
+{
+    const wchar_t* star = nullptr;
+    const wchar_t* resume = nullptr;
+
+    while (*value)
+    {
+        if (*mask == L'*')
+        {
+            star = mask++;
+            resume = value;
+        }
+        else if (*mask == L'?' || towlower(*mask) == towlower(*value))
+        {
+            mask++;
+            value++;
+        }
+        else if (star)
+        {
+            mask = star + 1;
+            value = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (*mask == L'*')
+        mask++;
+
+    return *mask == 0;
+}
+
+//YYYY.MM.DD as the day start in trade server time like the gap events, -1 if malformed
+static INT64 parseDate(const wchar_t* text)
+{
+    tm date = {};
+    if (swscanf_s(text, L"%d.%d.%d", &date.tm_year, &date.tm_mon, &date.tm_mday) != 3)
+        return -1;
+
+    date.tm_year -= 1900;
+    date.tm_mon -= 1;
+    return _mkgmtime(&date);
+}
+
+static double gapPoints(const GapEventRecord& record)
+{
+    if (record.Point <= 0)
+        return 0;
+
+    return std::max(fabs(record.OpenBid - record.CloseBid), fabs(record.OpenAsk - record.CloseAsk)) / record.Point;
+}
+
+static double percentileMs(std::vector<INT64>& values, double percentile)
+{
+    if (values.empty())
+        return 0;
+
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(percentile * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index] / 1000.0;
+}
+
+static void printGapAggregate(const std::wstring& symbol, GapAggregate& aggregate)
+{
+    double maxMs = aggregate.Latencies.empty() ? 0 : *std::max_element(aggregate.Latencies.begin(), aggregate.Latencies.end()) / 1000.0;
+    double avgPoints = aggregate.Events ? aggregate.PointsSum / aggregate.Events : 0;
+    double p50 = percentileMs(aggregate.Latencies, 0.5);
+    double p99 = percentileMs(aggregate.Latencies, 0.99);
+
+    wprintf(L"  %-16s %8llu %8llu %10llu %10llu %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", symbol.c_str(), aggregate.Events, aggregate.Locked,
+        aggregate.Positions, aggregate.Orders, aggregate.Deals, avgPoints, aggregate.PointsMax, p50, p99, maxMs);
+}
+
+//scans one partition, false if it cannot be read
+static bool scanGapPartition(const std::wstring& path, const GapQuery& query, std::map<std::wstring, GapAggregate>& aggregates)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size = {};
+    GetFileSizeEx(file, &size);
+    if (size.QuadPart < static_cast<INT64>(sizeof(GapEventFileHeader)))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    auto header = mapping != NULL ? static_cast<const GapEventFileHeader*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    bool valid = header != nullptr && header->Magic == GapEventFileHeader::MAGIC && header->RecordSize >= sizeof(GapEventRecord);
+
+    if (valid)
+    {
+        //the writer may have grown the file after it was mapped here
+        UINT64 mapped = (size.QuadPart - header->HeaderSize) / header->RecordSize;
+        UINT64 count = std::min<UINT64>(header->Count.load(std::memory_order_acquire), mapped);
+        auto records = reinterpret_cast<const char*>(header) + header->HeaderSize;
+
+        for (UINT64 i = 0; i < count; i++)
+        {
+            const auto& record = *reinterpret_cast<const GapEventRecord*>(records + i * header->RecordSize);
+            INT64 openTime = record.OpenTime / 1000;
+            if (openTime < query.From || openTime >= query.To || !matchMask(record.Symbol, query.SymbolMask.c_str()))
+                continue;
+
+            double points = gapPoints(record);
+            aggregates[record.Symbol].Add(record, points);
+
+            if (query.List)
+            {
+                time_t opened = static_cast<time_t>(openTime);
+                wchar_t openedText[32] = {};
+                wcsftime(openedText, 32, L"%Y.%m.%d %H:%M:%S", gmtime(&opened));
+
+                wprintf(L"%s %-16s close %.5f/%.5f open %.5f/%.5f gap %.1f pts, positions %u, orders %u, deals %u, fixed %u, %.1f ms\n",
+                    openedText, record.Symbol, record.CloseBid, record.CloseAsk, record.OpenBid, record.OpenAsk, points,
+                    record.Positions, record.Orders, record.Deals, record.Fixed, record.LatencyMicroseconds / 1000.0);
+            }
+        }
+    }
+
+    if (header != nullptr)
+        UnmapViewOfFile(header);
+    if (mapping != NULL)
+        CloseHandle(mapping);
+    CloseHandle(file);
+
+    return valid;
+}
+
+//gap event files of one directory, partitions entirely outside the range are not opened
+static void findGapPartitions(const std::wstring& directory, const GapQuery& query, std::vector<std::wstring>& partitions)
+{
+    WIN32_FIND_DATAW found;
+    std::wstring pattern = directory + L"\\" GAP_EVENT_FILE_PREFIX L"*" GAP_EVENT_FILE_EXTENSION;
+    HANDLE search = FindFirstFileW(pattern.c_str(), &found);
+    if (search == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        int year, month, day;
+        if (swscanf_s(found.cFileName, L"" GAP_EVENT_FILE_PREFIX L"%4d%2d%2d", &year, &month, &day) == 3)
+        {
+            tm date = {};
+            date.tm_year = year - 1900;
+            date.tm_mon = month - 1;
+            date.tm_mday = day;
+            INT64 start = _mkgmtime(&date);
+            if (start + 24 * 60 * 60 <= query.From || start >= query.To)
+                continue;
+        }
+
+        partitions.push_back(directory + L"\\" + found.cFileName);
+    } while (FindNextFileW(search, &found));
+
+    FindClose(search);
+}
+
+//the file name without the directory, so partitions of all members go by date
+static std::wstring partitionName(const std::wstring& path)
+{
+    return path.substr(path.find_last_of(L'\\') + 1);
+}
+
+static int queryGaps(const GapQuery& query)
+{
+    std::vector<std::wstring> partitions;
+
+    //partitioned plugins write into a subdirectory per member
+    if (!query.Member.empty())
+    {
+        findGapPartitions(query.Directory + L"\\" + query.Member, query, partitions);
+    }
+    else
+    {
+        findGapPartitions(query.Directory, query, partitions);
+
+        WIN32_FIND_DATAW found;
+        std::wstring pattern = query.Directory + L"\\*";
+        HANDLE search = FindFirstFileW(pattern.c_str(), &found);
+        if (search != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                std::wstring name = found.cFileName;
+                if ((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && name != L"." && name != L"..")
+                    findGapPartitions(query.Directory + L"\\" + name, query, partitions);
+            } while (FindNextFileW(search, &found));
+
+            FindClose(search);
+        }
+    }
+
+    if (partitions.empty())
+    {
+        fwprintf(stderr, L"No gap event files in %s%s%s\n", query.Directory.c_str(), query.Member.empty() ? L"" : L"\\", query.Member.c_str());
+        return 2;
+    }
+
+    std::sort(partitions.begin(), partitions.end(), [](const std::wstring& left, const std::wstring& right)
+    {
+        auto leftName = partitionName(left), rightName = partitionName(right);
+        return leftName != rightName ? leftName < rightName : left < right;
+    });
+
+    std::map<std::wstring, GapAggregate> aggregates;
+    for (const auto& path : partitions)
+    {
+        if (!scanGapPartition(path, query, aggregates))
+            fwprintf(stderr, L"Skip %s: not a gap event file\n", path.c_str());
+    }
+
+    wprintf(L"  %-16s %8s %8s %10s %10s %10s %10s %10s %10s %10s %10s\n", L"Symbol", L"events", L"locked", L"positions", L"orders", L"deals",
+        L"avg pts", L"max pts", L"p50 ms", L"p99 ms", L"max ms");
+
+    GapAggregate total;
+    for (auto& [symbol, aggregate] : aggregates)
+    {
+        total.Events += aggregate.Events;
+        total.Locked += aggregate.Locked;
+        total.Positions += aggregate.Positions;
+        total.Orders += aggregate.Orders;
+        total.Deals += aggregate.Deals;
+        total.PointsSum += aggregate.PointsSum;
+        total.PointsMax = std::max(total.PointsMax, aggregate.PointsMax);
+        total.Latencies.insert(total.Latencies.end(), aggregate.Latencies.begin(), aggregate.Latencies.end());
+
+        printGapAggregate(symbol, aggregate);
+    }
+
+    printGapAggregate(L"Total", total);
+    return 0;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    if (argc < 2)
+        return usage();
+
+    std::wstring command = argv[1];
+
+    if (command == L"stats")
+    {
+        std::wstring name = L"GapLocker";
+        int watchSeconds = 0;
+
+        for (int i = 2; i < argc; i++)
+        {
+            std::wstring arg = argv[i];
+            if (arg == L"--watch" && i + 1 < argc)
+                watchSeconds = _wtoi(argv[++i]);
+            else
+                name = arg;
+        }
+
+        return printStats(name, watchSeconds);
+    }
+
+    if (command == L"gaps" && argc >= 3)
+    {
+        GapQuery query;
+        query.Directory = argv[2];
+
+        for (int i = 3; i < argc; i++)
+        {
+            std::wstring arg = argv[i];
+            if (arg == L"--symbol" && i + 1 < argc)
+            {
+                query.SymbolMask = argv[++i];
+            }
+            else if (arg == L"--member" && i + 1 < argc)
+            {
+                query.Member = argv[++i];
+            }
+            else if (arg == L"--from" && i + 1 < argc)
+            {
+                query.From = parseDate(argv[++i]);
+            }
+            else if (arg == L"--to" && i + 1 < argc)
+            {
+                //the whole last day is included
+                query.To = parseDate(argv[++i]);
+                if (query.To >= 0)
+                    query.To += 24 * 60 * 60;
+            }
+            else if (arg == L"--list")
+            {
+                query.List = true;
+            }
+            else
+            {
+                return usage();
+            }
+
+            if (query.From < 0 || query.To < 0)
+                return usage();
+        }
+
+        return queryGaps(query);
+    }
+
+    return usage();
+}